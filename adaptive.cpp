@@ -0,0 +1,219 @@
+#include "adaptive.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+
+#include "coding.hpp"
+#include "stego.hpp"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #include <immintrin.h>
+    #define ADAPTIVE_SIMD 1
+#endif
+
+CostMap::CostMap(Image &image, uint8_t mode)
+    : data_(image.data()), width_(image.width()), height_(image.height()), channels_(image.channels()), keep_(~((1 << mode) - 1)){}
+
+//Sobel of one channel: left, center and right are the same channel of the neighbouring pixels, borders are repeated
+static inline uint8_t sobelCost(const uint8_t* above, const uint8_t* row, const uint8_t* below, uint64_t left, uint64_t center, uint64_t right, uint8_t keep){
+    auto at = [keep](const uint8_t* r, uint64_t i) { return int(r[i] & keep); };
+
+    int gx = (at(above, right) - at(above, left)) + 2 * (at(row, right) - at(row, left)) + (at(below, right) - at(below, left));
+    int gy = (at(below, left) + 2 * at(below, center) + at(below, right)) - (at(above, left) + 2 * at(above, center) + at(above, right));
+
+    return 255 - std::min(255, (std::abs(gx) + std::abs(gy)) >> 2);
+}
+
+void CostMap::row(int y, uint8_t* out) const{
+    uint64_t size = rowSize();
+    const uint8_t* row = data_ + y * size;
+    const uint8_t* above = y > 0 ? row - size : row;
+    const uint8_t* below = y + 1 < height_ ? row + size : row;
+
+    uint64_t i = 0;
+    for (; i < (uint64_t)channels_ && i < size; i++)
+        out[i] = sobelCost(above, row, below, i, i, i + channels_ < size ? i + channels_ : i, keep_);
+
+#ifdef ADAPTIVE_SIMD
+    const __m128i zero = _mm_setzero_si128(), keep = _mm_set1_epi8(keep_);
+
+    for (; i + channels_ + 16 <= size; i += 16){
+        auto load = [&](const uint8_t* r, uint64_t at) {
+            return _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r + at)), keep);
+        };
+
+        __m128i l0 = load(above, i - channels_), c0 = load(above, i), r0 = load(above, i + channels_);
+        __m128i l1 = load(row, i - channels_), r1 = load(row, i + channels_);
+        __m128i l2 = load(below, i - channels_), c2 = load(below, i), r2 = load(below, i + channels_);
+
+        //16 bit lanes, 8 channels per half
+        __m128i gradient[2];
+        for (int half = 0; half < 2; half++){
+            auto widen = [&](__m128i x) { return half ? _mm_unpackhi_epi8(x, zero) : _mm_unpacklo_epi8(x, zero); };
+
+            __m128i gx = _mm_add_epi16(_mm_sub_epi16(widen(r0), widen(l0)), _mm_sub_epi16(widen(r2), widen(l2)));
+            gx = _mm_add_epi16(gx, _mm_slli_epi16(_mm_sub_epi16(widen(r1), widen(l1)), 1));
+
+            __m128i gy = _mm_add_epi16(_mm_add_epi16(widen(l2), widen(r2)), _mm_slli_epi16(widen(c2), 1));
+            gy = _mm_sub_epi16(gy, _mm_add_epi16(_mm_add_epi16(widen(l0), widen(r0)), _mm_slli_epi16(widen(c0), 1)));
+
+            gx = _mm_max_epi16(gx, _mm_sub_epi16(zero, gx));
+            gy = _mm_max_epi16(gy, _mm_sub_epi16(zero, gy));
+            gradient[half] = _mm_srli_epi16(_mm_add_epi16(gx, gy), 2);
+        }
+
+        //saturated to 255 and inverted, flat areas cost the most
+        __m128i cost = _mm_xor_si128(_mm_packus_epi16(gradient[0], gradient[1]), _mm_set1_epi8(-1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), cost);
+    }
+#endif
+
+    for (; i < size; i++)
+        out[i] = sobelCost(above, row, below, i - channels_, i, i + channels_ < size ? i + channels_ : i, keep_);
+}
+
+uint8_t CostMap::cost(uint64_t index) const{
+    uint64_t size = rowSize();
+    int y = index / size;
+    uint64_t i = index % size;
+
+    const uint8_t* row = data_ + y * size;
+    const uint8_t* above = y > 0 ? row - size : row;
+    const uint8_t* below = y + 1 < height_ ? row + size : row;
+
+    return sobelCost(above, row, below, i >= (uint64_t)channels_ ? i - channels_ : i, i, i + channels_ < size ? i + channels_ : i, keep_);
+}
+
+uint8_t stcCost(uint8_t cost){
+    return std::min<int>(stcMaxCost, 1 + cost / 2);
+}
+
+uint8_t adaptiveThreshold(const CostMap &costs, uint64_t first, uint64_t needed){
+    Span span("costs");
+
+    uint64_t histogram[256] = {};
+    std::mutex lock;
+
+    //every band counts its own costs
+    runParallel(costs.height(), 1, [&](uint64_t firstRow, uint64_t rows) {
+        uint64_t local[256] = {};
+        std::vector<uint8_t> row(costs.rowSize());
+
+        //alpha costs are counted into an extra histogram and dropped
+        uint64_t alpha[256] = {};
+        int channels = costs.channels();
+        uint64_t* histograms[4] = {local, local, local, local};
+        if(channels % 2 == 0)
+            histograms[channels - 1] = alpha;
+
+        for (uint64_t y = firstRow; y < firstRow + rows; y++){
+            costs.row(y, row.data());
+
+            uint64_t base = y * costs.rowSize();
+            uint64_t i = base < first ? std::min(first - base, costs.rowSize()) : 0;
+
+            if(channels % 2 != 0){
+                for (; i < costs.rowSize(); i++)
+                    local[row[i]]++;
+            }
+            else{
+                for (int c = i % channels; i < costs.rowSize(); i++, c = c == channels - 1 ? 0 : c + 1)
+                    histograms[c][row[i]]++;
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        for (int t = 0; t < 256; t++)
+            histogram[t] += local[t];
+    });
+
+    uint64_t selected = 0;
+    for (int t = 0; t < 255; t++){
+        selected += histogram[t];
+        if(selected >= needed)
+            return t;
+    }
+
+    return 255;
+}
+
+Selection::Selection(const CostMap &costs, uint64_t first, uint8_t threshold){
+    Span span("selection");
+
+    uint64_t rowSize = costs.rowSize();
+    uint64_t total = rowSize * costs.height();
+    bits_.assign((total + 63) / 64 + 1, 0);
+
+    //bands start at a word so no two threads write the same word
+    uint64_t unit = 64 / std::gcd<uint64_t>(rowSize, 64);
+
+    runParallel(costs.height(), unit, [&](uint64_t firstRow, uint64_t rows) {
+        std::vector<uint8_t> row(rowSize);
+
+        for (uint64_t y = firstRow; y < firstRow + rows; y++){
+            costs.row(y, row.data());
+
+            uint64_t base = y * rowSize, i = 0;
+
+#ifdef ADAPTIVE_SIMD
+            const __m128i limit = _mm_set1_epi8(threshold);
+            for (; i + 16 <= rowSize; i += 16){
+                __m128i cost = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.data() + i));
+                uint64_t mask = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(cost, limit), cost));
+
+                uint64_t position = base + i;
+                bits_[position / 64] |= mask << (position % 64);
+                if(position % 64 > 48)
+                    bits_[position / 64 + 1] |= mask >> (64 - position % 64);
+            }
+#endif
+
+            for (; i < rowSize; i++)
+                if(row[i] <= threshold)
+                    bits_[(base + i) / 64] |= 1ull << ((base + i) % 64);
+        }
+    });
+
+    //alpha channels are every 2nd or 4th bit of every word, channels before the data are dropped
+    uint64_t usable = costs.channels() == 2 ? 0x5555555555555555 : costs.channels() == 4 ? 0x7777777777777777 : ~0ull;
+
+    ranks_.assign((bits_.size() + blockWords - 1) / blockWords + 1, 0);
+    for (uint64_t word = 0; word < bits_.size(); word++){
+        bits_[word] &= usable;
+
+        if((word + 1) * 64 <= first)
+            bits_[word] = 0;
+        else if(word * 64 < first)
+            bits_[word] &= ~0ull << (first - word * 64);
+
+        ranks_[word / blockWords + 1] += __builtin_popcountll(bits_[word]);
+    }
+
+    for (uint64_t block = 1; block < ranks_.size(); block++)
+        ranks_[block] += ranks_[block - 1];
+}
+
+uint64_t Selection::position(uint64_t slot) const{
+    uint64_t block = std::upper_bound(ranks_.begin(), ranks_.end(), slot) - ranks_.begin() - 1;
+    uint64_t remaining = slot - ranks_[block];
+
+    uint64_t word = block * blockWords;
+    while ((uint64_t)__builtin_popcountll(bits_[word]) <= remaining)
+        remaining -= __builtin_popcountll(bits_[word++]);
+
+    uint64_t bits = bits_[word];
+    for (; remaining > 0; remaining--)
+        bits &= bits - 1;
+
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+Selection::Cursor::Cursor(const Selection &selection, uint64_t slot) : bits_(selection.bits_.data()), word_(0), remaining_(0){
+    if(slot >= selection.count())
+        return;
+
+    uint64_t index = selection.position(slot);
+    word_ = index / 64;
+    remaining_ = bits_[word_] & (~0ull << (index % 64));
+}
@@ -0,0 +1,87 @@
+#ifndef ADAPTIVE_HPP
+#define ADAPTIVE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "image.hpp"
+
+/*
+    Content adaptive embedding: every channel gets a cost from the Sobel gradient of its own color plane
+    (255 on flat areas, lower on edges and texture) and data only goes to the channels whose cost is at most
+    a threshold, the lowest one that leaves enough channels for the data.
+
+    Costs are computed with the low 'mode' bits of every channel cleared, which are the only bits
+    replacement changes, so the retriever gets the same costs and the same channels from the stego image
+    with the threshold from the header. Rows are processed 16 channels at a time with SSE2, in parallel bands.
+*/
+
+class CostMap{
+
+	private:
+		const uint8_t* data_;
+		int width_;
+		int height_;
+		int channels_;
+		uint8_t keep_; //bits that take part in the cost
+
+	public:
+		CostMap(Image &image, uint8_t mode);
+
+		//costs of every channel of row 'y' (alpha included) into 'out'
+		void row(int y, uint8_t* out) const;
+
+		//cost of the channel at image index 'index'
+		uint8_t cost(uint64_t index) const;
+
+		uint64_t rowSize() const { return (uint64_t)width_ * channels_; }
+		int height() const { return height_; }
+		int channels() const { return channels_; }
+};
+
+//STC flip cost of a channel, 1 to stcMaxCost
+uint8_t stcCost(uint8_t cost);
+
+//lowest threshold that selects at least 'needed' usable channels from image index 'first'
+uint8_t adaptiveThreshold(const CostMap &costs, uint64_t first, uint64_t needed);
+
+//usable channels from image index 'first' with a cost of at most the threshold, in image order
+class Selection{
+
+	private:
+		static constexpr uint64_t blockWords = 8;
+
+		std::vector<uint64_t> bits_;   //one bit per image channel
+		std::vector<uint64_t> ranks_;  //selected channels before every block of blockWords words
+
+	public:
+		Selection(const CostMap &costs, uint64_t first, uint8_t threshold);
+
+		uint64_t count() const { return ranks_.back(); }
+
+		//image index of selected channel 'slot'
+		uint64_t position(uint64_t slot) const;
+
+		//walks the selected channels in order from a slot
+		class Cursor{
+
+			private:
+				const uint64_t* bits_;
+				uint64_t word_;
+				uint64_t remaining_;
+
+			public:
+				Cursor(const Selection &selection, uint64_t slot);
+
+				uint64_t next(){
+					while (remaining_ == 0)
+						remaining_ = bits_[++word_];
+
+					uint64_t index = word_ * 64 + __builtin_ctzll(remaining_);
+					remaining_ &= remaining_ - 1;
+					return index;
+				}
+		};
+};
+
+#endif
@@ -0,0 +1,465 @@
+#include "aes.hpp"
+
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #include <immintrin.h>
+    #define AES_NI 1
+#endif
+
+static constexpr uint8_t sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static constexpr uint8_t xtime(uint8_t x){
+    return (x << 1) ^ ((x >> 7) * 0x1b);
+}
+
+//multiplication in GF(2^8)
+static constexpr uint8_t multiply(uint8_t x, uint8_t y){
+    uint8_t product = 0;
+    for (; y; y >>= 1, x = xtime(x))
+        if(y & 1)
+            product ^= x;
+
+    return product;
+}
+
+static constexpr std::array<uint8_t, 256> makeInverseSbox(){
+    std::array<uint8_t, 256> inverse{};
+    for (int i = 0; i < 256; i++)
+        inverse[sbox[i]] = i;
+
+    return inverse;
+}
+
+//column contribution of a byte in row 0: {2s, s, s, 3s}, other rows are rotations of it
+static constexpr std::array<uint32_t, 256> makeTable(){
+    std::array<uint32_t, 256> table{};
+    for (int i = 0; i < 256; i++){
+        uint8_t s = sbox[i];
+        table[i] = xtime(s) | s << 8 | s << 16 | (uint32_t)(xtime(s) ^ s) << 24;
+    }
+
+    return table;
+}
+
+static constexpr std::array<uint8_t, 256> inverseSbox = makeInverseSbox();
+static constexpr std::array<uint32_t, 256> table = makeTable();
+
+static constexpr uint8_t roundConstant[11] = {0x8d, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+
+static inline uint32_t rotate(uint32_t x, int bits){
+    return (x << bits) | (x >> (32 - bits));
+}
+
+//columns are little endian words, byte 0 is row 0
+static inline uint32_t load(const uint8_t* data){
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static inline void store(uint8_t* data, uint32_t value){
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+#ifdef AES_NI
+
+//built with -maes there is nothing to check
+static bool aesNi(){
+#ifdef __AES__
+    return true;
+#else
+    static const bool supported = __builtin_cpu_supports("aes");
+    return supported;
+#endif
+}
+
+//AES-NI, the round keys are the same bytes as the table version's so one schedule serves both
+
+//every word of 'key' xored with all the words below it
+__attribute__((target("aes")))
+static inline __m128i prefixXor(__m128i key){
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, _mm_slli_si128(key, 4));
+}
+
+//next 4 words from the 4 before them and aeskeygenassist of the last ones, with RotWord and the round constant
+__attribute__((target("aes")))
+static inline __m128i even(__m128i previous, __m128i assisted){
+    return _mm_xor_si128(prefixXor(previous), _mm_shuffle_epi32(assisted, 0xff));
+}
+
+//the same with SubWord only, the odd round keys of AES-256
+__attribute__((target("aes")))
+static inline __m128i odd(__m128i previous, __m128i assisted){
+    return _mm_xor_si128(prefixXor(previous), _mm_shuffle_epi32(assisted, 0xaa));
+}
+
+//the round constant of aeskeygenassist has to be an immediate
+template<int Rcon>
+__attribute__((target("aes")))
+static inline __m128i assist(__m128i key){
+    return _mm_aeskeygenassist_si128(key, Rcon);
+}
+
+__attribute__((target("aes")))
+static void expand128(const uint8_t* key, __m128i* roundKeys){
+    roundKeys[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+
+    roundKeys[1] = even(roundKeys[0], assist<0x01>(roundKeys[0]));
+    roundKeys[2] = even(roundKeys[1], assist<0x02>(roundKeys[1]));
+    roundKeys[3] = even(roundKeys[2], assist<0x04>(roundKeys[2]));
+    roundKeys[4] = even(roundKeys[3], assist<0x08>(roundKeys[3]));
+    roundKeys[5] = even(roundKeys[4], assist<0x10>(roundKeys[4]));
+    roundKeys[6] = even(roundKeys[5], assist<0x20>(roundKeys[5]));
+    roundKeys[7] = even(roundKeys[6], assist<0x40>(roundKeys[6]));
+    roundKeys[8] = even(roundKeys[7], assist<0x80>(roundKeys[7]));
+    roundKeys[9] = even(roundKeys[8], assist<0x1b>(roundKeys[8]));
+    roundKeys[10] = even(roundKeys[9], assist<0x36>(roundKeys[9]));
+}
+
+//words of the 192 bit schedule are produced 6 at a time, 'low' holds 4 of them and the first 2 of 'high'
+__attribute__((target("aes")))
+static inline void step192(__m128i &low, __m128i &high, __m128i assisted){
+    low = _mm_xor_si128(prefixXor(low), _mm_shuffle_epi32(assisted, 0x55));
+    high = _mm_xor_si128(_mm_xor_si128(high, _mm_slli_si128(high, 4)), _mm_shuffle_epi32(low, 0xff));
+}
+
+__attribute__((target("aes")))
+static void expand192(const uint8_t* key, __m128i* roundKeys){
+    uint8_t words[4 * 13 * 4];
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+    __m128i high = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(key + 16));
+
+    //6 new words per step, the last step only needs 4 of them
+    for (int step = 0; ; step++){
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(words + step * 24), low);
+        if(step == 8)
+            break;
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(words + step * 24 + 16), high);
+
+        switch (step){
+            case 0: step192(low, high, assist<0x01>(high)); break;
+            case 1: step192(low, high, assist<0x02>(high)); break;
+            case 2: step192(low, high, assist<0x04>(high)); break;
+            case 3: step192(low, high, assist<0x08>(high)); break;
+            case 4: step192(low, high, assist<0x10>(high)); break;
+            case 5: step192(low, high, assist<0x20>(high)); break;
+            case 6: step192(low, high, assist<0x40>(high)); break;
+            case 7: step192(low, high, assist<0x80>(high)); break;
+        }
+    }
+
+    for (int i = 0; i < 13; i++)
+        roundKeys[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i * aesBlockSize));
+
+    volatile uint8_t *bytes = words;
+    for (size_t i = 0; i < sizeof(words); i++)
+        bytes[i] = 0;
+}
+
+__attribute__((target("aes")))
+static void expand256(const uint8_t* key, __m128i* roundKeys){
+    roundKeys[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+    roundKeys[1] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + 16));
+
+    roundKeys[2] = even(roundKeys[0], assist<0x01>(roundKeys[1]));
+    roundKeys[3] = odd(roundKeys[1], assist<0x00>(roundKeys[2]));
+    roundKeys[4] = even(roundKeys[2], assist<0x02>(roundKeys[3]));
+    roundKeys[5] = odd(roundKeys[3], assist<0x00>(roundKeys[4]));
+    roundKeys[6] = even(roundKeys[4], assist<0x04>(roundKeys[5]));
+    roundKeys[7] = odd(roundKeys[5], assist<0x00>(roundKeys[6]));
+    roundKeys[8] = even(roundKeys[6], assist<0x08>(roundKeys[7]));
+    roundKeys[9] = odd(roundKeys[7], assist<0x00>(roundKeys[8]));
+    roundKeys[10] = even(roundKeys[8], assist<0x10>(roundKeys[9]));
+    roundKeys[11] = odd(roundKeys[9], assist<0x00>(roundKeys[10]));
+    roundKeys[12] = even(roundKeys[10], assist<0x20>(roundKeys[11]));
+    roundKeys[13] = odd(roundKeys[11], assist<0x00>(roundKeys[12]));
+    roundKeys[14] = even(roundKeys[12], assist<0x40>(roundKeys[13]));
+}
+
+template<int Rounds>
+__attribute__((target("aes")))
+static inline __m128i encryptNi(__m128i block, const __m128i* roundKeys){
+    block = _mm_xor_si128(block, roundKeys[0]);
+    for (int round = 1; round < Rounds; round++)
+        block = _mm_aesenc_si128(block, roundKeys[round]);
+
+    return _mm_aesenclast_si128(block, roundKeys[Rounds]);
+}
+
+template<int Rounds>
+__attribute__((target("aes")))
+static void encryptBlockNi(const uint8_t* roundKey, uint8_t* block){
+    __m128i roundKeys[Rounds + 1];
+    for (int i = 0; i <= Rounds; i++)
+        roundKeys[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(roundKey + i * aesBlockSize));
+
+    __m128i *data = reinterpret_cast<__m128i*>(block);
+    _mm_storeu_si128(data, encryptNi<Rounds>(_mm_loadu_si128(data), roundKeys));
+}
+
+//CTR with 8 blocks in flight, aesenc has a latency of several cycles but a throughput of one or two per cycle
+template<int Rounds>
+__attribute__((target("aes")))
+static void ctrNi(const uint8_t* roundKey, uint8_t* counter, uint8_t* data, uint64_t size){
+    __m128i roundKeys[Rounds + 1];
+    for (int i = 0; i <= Rounds; i++)
+        roundKeys[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(roundKey + i * aesBlockSize));
+
+    //the big endian counter as two native halves
+    uint64_t high, low;
+    std::memcpy(&high, counter, 8);
+    std::memcpy(&low, counter + 8, 8);
+    high = __builtin_bswap64(high);
+    low = __builtin_bswap64(low);
+
+    for (; size >= 8 * aesBlockSize; size -= 8 * aesBlockSize, data += 8 * aesBlockSize){
+        __m128i blocks[8];
+        for (int i = 0; i < 8; i++){
+            blocks[i] = _mm_xor_si128(_mm_set_epi64x(__builtin_bswap64(low), __builtin_bswap64(high)), roundKeys[0]);
+            high += ++low == 0;
+        }
+
+        for (int round = 1; round < Rounds; round++)
+            for (int i = 0; i < 8; i++)
+                blocks[i] = _mm_aesenc_si128(blocks[i], roundKeys[round]);
+
+        for (int i = 0; i < 8; i++){
+            __m128i *chunk = reinterpret_cast<__m128i*>(data + i * aesBlockSize);
+            _mm_storeu_si128(chunk, _mm_xor_si128(_mm_loadu_si128(chunk), _mm_aesenclast_si128(blocks[i], roundKeys[Rounds])));
+        }
+    }
+
+    for (; size > 0; data += aesBlockSize){
+        __m128i keystream = encryptNi<Rounds>(_mm_set_epi64x(__builtin_bswap64(low), __builtin_bswap64(high)), roundKeys);
+        high += ++low == 0;
+
+        if(size >= aesBlockSize){
+            __m128i *chunk = reinterpret_cast<__m128i*>(data);
+            _mm_storeu_si128(chunk, _mm_xor_si128(_mm_loadu_si128(chunk), keystream));
+            size -= aesBlockSize;
+        }
+        else{
+            uint8_t bytes[aesBlockSize];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), keystream);
+            for (uint64_t i = 0; i < size; i++)
+                data[i] ^= bytes[i];
+            size = 0;
+        }
+    }
+
+    high = __builtin_bswap64(high);
+    low = __builtin_bswap64(low);
+    std::memcpy(counter, &high, 8);
+    std::memcpy(counter + 8, &low, 8);
+}
+
+#endif
+
+template<int KeySize>
+Aes<KeySize>::Aes(const uint8_t* key){
+    constexpr int words = KeySize / 4;
+
+#ifdef AES_NI
+    if(aesNi()){
+        __m128i roundKeys[rounds + 1];
+
+        if constexpr (KeySize == 16)
+            expand128(key, roundKeys);
+        else if constexpr (KeySize == 24)
+            expand192(key, roundKeys);
+        else
+            expand256(key, roundKeys);
+
+        std::memcpy(roundKey_, roundKeys, sizeof(roundKey_));
+
+        volatile uint8_t *bytes = reinterpret_cast<uint8_t*>(roundKeys);
+        for (size_t i = 0; i < sizeof(roundKeys); i++)
+            bytes[i] = 0;
+
+        return;
+    }
+#endif
+
+    std::memcpy(roundKey_, key, KeySize);
+
+    for (int i = words; i < 4 * (rounds + 1); i++){
+        uint8_t temp[4];
+        std::memcpy(temp, roundKey_ + (i - 1) * 4, 4);
+
+        if(i % words == 0){
+            uint8_t first = temp[0];
+            temp[0] = sbox[temp[1]] ^ roundConstant[i / words];
+            temp[1] = sbox[temp[2]];
+            temp[2] = sbox[temp[3]];
+            temp[3] = sbox[first];
+        }
+        else if(words > 6 && i % words == 4){
+            for (uint8_t &byte : temp)
+                byte = sbox[byte];
+        }
+
+        for (int j = 0; j < 4; j++)
+            roundKey_[i * 4 + j] = roundKey_[(i - words) * 4 + j] ^ temp[j];
+    }
+}
+
+template<int KeySize>
+Aes<KeySize>::~Aes(){
+    volatile uint8_t *bytes = roundKey_;
+    for (size_t i = 0; i < sizeof(roundKey_); i++)
+        bytes[i] = 0;
+}
+
+template<int KeySize>
+void Aes<KeySize>::encryptBlock(uint8_t* block) const{
+#ifdef AES_NI
+    if(aesNi())
+        return encryptBlockNi<rounds>(roundKey_, block);
+#endif
+
+    uint32_t state[4], next[4];
+
+    for (int c = 0; c < 4; c++)
+        state[c] = load(block + c * 4) ^ load(roundKey_ + c * 4);
+
+    //rounds is a constant, so this loop is fully unrolled for every key size
+    for (int round = 1; round < rounds; round++){
+        for (int c = 0; c < 4; c++){
+            next[c] = table[state[c] & 0xff]
+                    ^ rotate(table[(state[(c + 1) & 3] >> 8) & 0xff], 8)
+                    ^ rotate(table[(state[(c + 2) & 3] >> 16) & 0xff], 16)
+                    ^ rotate(table[state[(c + 3) & 3] >> 24], 24)
+                    ^ load(roundKey_ + round * aesBlockSize + c * 4);
+        }
+
+        std::memcpy(state, next, sizeof(state));
+    }
+
+    //last round has no MixColumns
+    for (int c = 0; c < 4; c++){
+        next[c] = sbox[state[c] & 0xff]
+                | sbox[(state[(c + 1) & 3] >> 8) & 0xff] << 8
+                | sbox[(state[(c + 2) & 3] >> 16) & 0xff] << 16
+                | (uint32_t)sbox[state[(c + 3) & 3] >> 24] << 24;
+
+        store(block + c * 4, next[c] ^ load(roundKey_ + rounds * aesBlockSize + c * 4));
+    }
+}
+
+template<int KeySize>
+void Aes<KeySize>::decryptBlock(uint8_t* block) const{
+    uint8_t state[aesBlockSize];
+
+    for (uint64_t i = 0; i < aesBlockSize; i++)
+        state[i] = block[i] ^ roundKey_[rounds * aesBlockSize + i];
+
+    for (int round = rounds - 1; round >= 0; round--){
+        //InvShiftRows and InvSubBytes, byte (column c, row r) comes from column c - r
+        uint8_t shifted[aesBlockSize];
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                shifted[c * 4 + r] = inverseSbox[state[((c - r + 4) & 3) * 4 + r]];
+
+        for (uint64_t i = 0; i < aesBlockSize; i++)
+            state[i] = shifted[i] ^ roundKey_[round * aesBlockSize + i];
+
+        if(round == 0)
+            break;
+
+        //InvMixColumns
+        for (int c = 0; c < 4; c++){
+            uint8_t a = state[c * 4], b = state[c * 4 + 1], d = state[c * 4 + 2], e = state[c * 4 + 3];
+
+            state[c * 4]     = multiply(a, 0x0e) ^ multiply(b, 0x0b) ^ multiply(d, 0x0d) ^ multiply(e, 0x09);
+            state[c * 4 + 1] = multiply(a, 0x09) ^ multiply(b, 0x0e) ^ multiply(d, 0x0b) ^ multiply(e, 0x0d);
+            state[c * 4 + 2] = multiply(a, 0x0d) ^ multiply(b, 0x09) ^ multiply(d, 0x0e) ^ multiply(e, 0x0b);
+            state[c * 4 + 3] = multiply(a, 0x0b) ^ multiply(b, 0x0d) ^ multiply(d, 0x09) ^ multiply(e, 0x0e);
+        }
+    }
+
+    std::memcpy(block, state, aesBlockSize);
+}
+
+template<int KeySize>
+void Aes<KeySize>::ctr(uint8_t* counter, uint8_t* data, uint64_t size) const{
+#ifdef AES_NI
+    if(aesNi())
+        return ctrNi<rounds>(roundKey_, counter, data, size);
+#endif
+
+    uint8_t keystream[aesBlockSize];
+
+    for (uint64_t offset = 0; offset < size; offset += aesBlockSize){
+        std::memcpy(keystream, counter, aesBlockSize);
+        encryptBlock(keystream);
+
+        //big endian increment of the whole block
+        for (int i = aesBlockSize - 1; i >= 0 && ++counter[i] == 0; i--);
+
+        uint64_t length = size - offset < aesBlockSize ? size - offset : aesBlockSize;
+        if(length == aesBlockSize){
+            uint64_t x[2], y[2];
+            std::memcpy(x, data + offset, aesBlockSize);
+            std::memcpy(y, keystream, aesBlockSize);
+            x[0] ^= y[0];
+            x[1] ^= y[1];
+            std::memcpy(data + offset, x, aesBlockSize);
+        }
+        else{
+            for (uint64_t i = 0; i < length; i++)
+                data[offset + i] ^= keystream[i];
+        }
+    }
+}
+
+template<int KeySize>
+void Aes<KeySize>::seek(uint8_t* counter, const uint8_t* iv, uint64_t position){
+    std::memcpy(counter, iv, aesBlockSize);
+
+    //big endian addition of the block index
+    uint64_t carry = position / aesBlockSize;
+    for (int i = aesBlockSize - 1; i >= 0 && carry > 0; i--){
+        uint64_t sum = counter[i] + carry;
+        counter[i] = sum & UINT8_MAX;
+        carry = sum >> 8;
+    }
+}
+
+template class Aes<16>;
+template class Aes<24>;
+template class Aes<32>;
+
+AesCipher makeAesCipher(const uint8_t* key, uint8_t keySize){
+    switch (keySize){
+        case 16: return AesCipher(std::in_place_type<Aes<16>>, key);
+        case 24: return AesCipher(std::in_place_type<Aes<24>>, key);
+        case 32: return AesCipher(std::in_place_type<Aes<32>>, key);
+    }
+
+    throw std::runtime_error("Invalid key size " + std::to_string(keySize) + ". Must be 16, 24, or 32 bytes.");
+}
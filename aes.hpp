@@ -0,0 +1,53 @@
+#ifndef AES_HPP
+#define AES_HPP
+
+#include <cstdint>
+#include <variant>
+
+inline constexpr uint64_t aesBlockSize = 16; //block size of every AES variant, CTR counters advance per block
+
+/*
+    AES with the round count fixed at compile time for every key size
+    (AES-128: 10 rounds, AES-192: 12, AES-256: 14), the key size is dispatched once per job
+    with std::visit on AesCipher instead of being checked for every block.
+
+    On x86-64 cpus with AES-NI (checked once with cpuid, or always with -maes) the key is expanded
+    with aeskeygenassist and blocks are encrypted with aesenc, CTR mode keeps 8 blocks in flight.
+    The round keys are the same bytes either way, so the schedule Key caches serves both paths.
+    Otherwise encryption uses 32-bit lookup tables that merge SubBytes, ShiftRows and MixColumns.
+    Decryption is only needed for header block 0 and is done byte by byte.
+    Based on tiny-AES (https://github.com/kokke/tiny-AES-c), CTR mode is compatible with it.
+*/
+
+template<int KeySize>
+class Aes{
+
+	static_assert(KeySize == 16 || KeySize == 24 || KeySize == 32, "AES keys are 16, 24 or 32 bytes");
+
+	public:
+		static constexpr int keySize = KeySize;
+		static constexpr int rounds = KeySize / 4 + 6;
+
+	private:
+		uint8_t roundKey_[aesBlockSize * (rounds + 1)];
+
+	public:
+		explicit Aes(const uint8_t* key);
+		~Aes(); //round keys are zeroized
+
+		void encryptBlock(uint8_t* block) const;
+		void decryptBlock(uint8_t* block) const;
+
+		//CTR mode, 'counter' is the counter block of the first block of data and is advanced past the last
+		void ctr(uint8_t* counter, uint8_t* data, uint64_t size) const;
+
+		//counter block of byte 'position' (a multiple of aesBlockSize) of a stream that starts at 'iv'
+		static void seek(uint8_t* counter, const uint8_t* iv, uint64_t position);
+};
+
+using AesCipher = std::variant<Aes<16>, Aes<24>, Aes<32>>;
+
+//expands 'key' with the instantiation for 'keySize', throws for other sizes
+AesCipher makeAesCipher(const uint8_t* key, uint8_t keySize);
+
+#endif
@@ -0,0 +1,344 @@
+#include "arena.hpp"
+#include "stego.hpp"
+#include "numa.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+static constexpr uint64_t alignment = 64; //cache line
+static constexpr uint64_t hugePageSize = 2 << 20;
+static constexpr uint64_t pageSize = 4096;
+static constexpr uint64_t reserveSize = sizeof(void*) == 8 ? 64ull << 30 : 0; //only address space, pages are mapped on first touch
+
+//stored right before every allocation
+struct Block{
+    uint64_t size;
+    uint64_t capacity; //bytes up to the next block, a freed block is reused for any size that fits
+    uint64_t previous; //offset before the allocation, restored when it is the last one freed
+    Block *below;      //block allocated right before it
+    Block *prev, *next; //free list of its size class while it is freed
+    bool freed;
+};
+
+static constexpr int sizeClasses = 64;
+
+static std::mutex arenaMutex;
+static uint8_t *base = nullptr;
+static uint64_t offset = 0;
+static uint64_t live = 0;
+static Block *top = nullptr; //last allocation
+static Block *freeLists[sizeClasses] = {}; //freed blocks below the last allocation, by floor(log2(capacity))
+static uint64_t faulted = 0; //the region is mapped up to here
+static bool reserved = false;
+
+bool Arena::hugePages = true;
+bool Arena::prefault = false;
+
+static bool large(uint64_t size){
+    return Arena::hugePages && size >= hugePageSize;
+}
+
+//large buffers are first touched by the worker threads, so NUMA local mode places them too
+static bool touched(uint64_t size){
+    return (Arena::prefault || numaMode == Numa::local) && size >= hugePageSize;
+}
+
+//writes one byte of every page, the memory is not in use yet
+static void touch(uint8_t* data, uint64_t size){
+    Span span("prefault", size);
+
+    runParallel(size, pageSize, [data](uint64_t offset, uint64_t size) {
+        for (uint64_t i = 0; i < size; i += pageSize)
+            static_cast<volatile uint8_t*>(data)[offset + i] = 0;
+    });
+}
+
+static void reserve(){
+    reserved = true;
+
+#if defined(__linux__)
+    if(reserveSize == 0)
+        return;
+
+    //extra huge page to align the start, so huge pages line up with the region
+    void *region = mmap(nullptr, reserveSize + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(region == MAP_FAILED)
+        return;
+
+    base = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(region) + hugePageSize - 1) & ~(hugePageSize - 1));
+
+#ifdef MADV_HUGEPAGE
+    if(Arena::hugePages)
+        madvise(base, reserveSize, MADV_HUGEPAGE);
+#endif
+
+    if(numaMode == Numa::interleave)
+        interleavePages(base, reserveSize);
+#endif
+}
+
+static bool owns(const void* pointer){
+    return base != nullptr && pointer >= base && pointer < base + reserveSize;
+}
+
+static Block* block(void* pointer){
+    return reinterpret_cast<Block*>(static_cast<uint8_t*>(pointer) - sizeof(Block));
+}
+
+//class of the blocks that can hold 'size': ceil(log2(size))
+static int sizeClass(uint64_t size){
+    return size <= 1 ? 0 : 64 - __builtin_clzll(size - 1);
+}
+
+//caller holds the lock
+static void pushFree(Block* header){
+    header->freed = true;
+    header->prev = nullptr;
+    header->next = nullptr;
+
+    //too small to be worth reusing, it comes back when the blocks above it are freed
+    if(header->capacity < alignment)
+        return;
+
+    int index = 63 - __builtin_clzll(header->capacity);
+    header->next = freeLists[index];
+    if(header->next != nullptr)
+        header->next->prev = header;
+    freeLists[index] = header;
+}
+
+//caller holds the lock
+static void unlinkFree(Block* header){
+    if(header->capacity < alignment)
+        return;
+
+    int index = 63 - __builtin_clzll(header->capacity);
+    if(header->prev != nullptr)
+        header->prev->next = header->next;
+    else
+        freeLists[index] = header->next;
+
+    if(header->next != nullptr)
+        header->next->prev = header->prev;
+}
+
+//takes a freed block out of its list for an allocation of 'size', caller holds the lock
+static void* take(Block* header, uint64_t size){
+    unlinkFree(header);
+    header->freed = false;
+    header->size = size;
+    live++;
+
+    return reinterpret_cast<uint8_t*>(header) + sizeof(Block);
+}
+
+//a freed block that fits 'size', caller holds the lock
+//the class below holds blocks that may fit, a few of them are checked before the first block of the two classes that always fit,
+//so at most 4x the size is held. Huge page sized allocations only take blocks that start on a huge page.
+static void* reuse(uint64_t size){
+    int first = sizeClass(std::max(size, alignment));
+    auto fits = [size](const Block* header) {
+        return header->capacity >= size && (!large(size) || (reinterpret_cast<uintptr_t>(header + 1) & (hugePageSize - 1)) == 0);
+    };
+
+    Block *header = first > 0 ? freeLists[first - 1] : nullptr;
+    for (int i = 0; i < 8 && header != nullptr; i++, header = header->next)
+        if(fits(header))
+            return take(header, size);
+
+    for (int index = first; index < std::min(first + 2, sizeClasses); index++)
+        for (header = freeLists[index]; header != nullptr; header = header->next)
+            if(fits(header))
+                return take(header, size);
+
+    return nullptr;
+}
+
+//pages of the region from the mapped mark to 'end' that have to be touched, caller holds the lock
+static uint64_t unmapped(uint64_t end, uint8_t* &first){
+    uint64_t start = std::max(faulted, (uint64_t)(first - base)) & ~(pageSize - 1);
+    if(end <= start)
+        return 0;
+
+    faulted = std::max(faulted, end);
+    first = base + start;
+    return end - start;
+}
+
+//caller holds the lock
+static void* bump(uint64_t size){
+    if(!reserved)
+        reserve();
+
+    if(base == nullptr)
+        return nullptr;
+
+    void *reused = reuse(size);
+    if(reused != nullptr)
+        return reused;
+
+    uint64_t align = large(size) ? hugePageSize : alignment;
+    uint64_t start = (offset + sizeof(Block) + align - 1) & ~(align - 1);
+    if(size > reserveSize || start > reserveSize - size)
+        return nullptr;
+
+    uint8_t *pointer = base + start;
+    *block(pointer) = {size, size, offset, top, nullptr, nullptr, false};
+    top = block(pointer);
+
+    offset = start + size;
+    live++;
+
+    return pointer;
+}
+
+//fallback for large allocations when the arena is not available, placed the same way
+static void* allocateHuge(uint64_t size){
+    uint64_t rounded = (size + hugePageSize - 1) & ~(hugePageSize - 1);
+    void *pointer = std::aligned_alloc(hugePageSize, rounded);
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if(pointer != nullptr && Arena::hugePages)
+        madvise(pointer, rounded, MADV_HUGEPAGE);
+#endif
+
+    if(pointer != nullptr && numaMode == Numa::interleave)
+        interleavePages(pointer, rounded);
+
+    if(pointer != nullptr && touched(size))
+        touch(static_cast<uint8_t*>(pointer), size);
+
+    return pointer;
+}
+
+void* Arena::allocate(uint64_t size){
+    uint8_t *pointer = nullptr, *first = nullptr;
+    uint64_t touchSize = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(arenaMutex);
+        pointer = static_cast<uint8_t*>(bump(size));
+
+        if(pointer != nullptr && touched(size)){
+            first = pointer;
+            touchSize = unmapped(pointer - base + size, first);
+        }
+    }
+
+    if(touchSize > 0)
+        touch(first, touchSize);
+
+    if(pointer != nullptr)
+        return pointer;
+
+    return large(size) || touched(size) ? allocateHuge(size) : std::malloc(size);
+}
+
+void* Arena::reallocate(void* pointer, uint64_t size){
+    if(pointer == nullptr)
+        return allocate(size);
+
+    if(!owns(pointer))
+        return std::realloc(pointer, size);
+
+    uint64_t oldSize;
+    uint8_t *first = nullptr;
+    uint64_t touchSize = 0;
+    bool inPlace = false;
+    {
+        std::lock_guard<std::mutex> lock(arenaMutex);
+        Block *header = block(pointer);
+        uint64_t start = static_cast<uint8_t*>(pointer) - base;
+        oldSize = header->size;
+
+        //the last allocation grows or shrinks in place
+        if(header == top && size <= reserveSize - start){
+            header->size = size;
+            header->capacity = size;
+            offset = start + size;
+            inPlace = true;
+
+            if(touched(size)){
+                first = static_cast<uint8_t*>(pointer) + oldSize;
+                touchSize = unmapped(offset, first);
+            }
+        }
+        //others as long as they fit the space they were given
+        else if(header != top && size <= header->capacity){
+            header->size = size;
+            inPlace = true;
+        }
+    }
+
+    if(inPlace){
+        if(touchSize > 0)
+            touch(first, touchSize);
+
+        return pointer;
+    }
+
+    void *moved = allocate(size);
+    if(moved == nullptr)
+        return nullptr;
+
+    std::memcpy(moved, pointer, oldSize < size ? oldSize : size);
+    release(pointer);
+
+    return moved;
+}
+
+void Arena::release(void* pointer){
+    if(pointer == nullptr)
+        return;
+
+    if(!owns(pointer)){
+        std::free(pointer);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    Block *header = block(pointer);
+    live--;
+
+    if(header != top){
+        pushFree(header);
+        return;
+    }
+
+    //the last allocation gives its space back, with the freed blocks right below it
+    offset = header->previous;
+    top = header->below;
+
+    while(top != nullptr && top->freed){
+        unlinkFree(top);
+        offset = top->previous;
+        top = top->below;
+    }
+}
+
+uint8_t* Arena::buffer(uint64_t size){
+    void *pointer = allocate(size);
+    if(pointer == nullptr)
+        throw std::runtime_error("Could not allocate " + std::to_string(size) + " bytes.");
+
+    return static_cast<uint8_t*>(pointer);
+}
+
+void Arena::reset(){
+    std::lock_guard<std::mutex> lock(arenaMutex);
+
+    if(live != 0)
+        throw std::runtime_error("Arena reset with " + std::to_string(live) + " allocations in use.");
+
+    offset = 0;
+    top = nullptr;
+    std::fill_n(freeLists, sizeClasses, nullptr);
+}
@@ -0,0 +1,49 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstdint>
+
+/*
+    Scratch memory of a job: decoded pixels, file data, retrieval buffers and stb's PNG buffers.
+
+    Allocations are taken from one reserved region by bumping an offset, the region is backed by
+    huge pages when the system allows it. Reallocating the last allocation grows it in place, freeing
+    it gives its space back together with the freed blocks right below it.
+    Other freed blocks go to a free list of their power of two size class and are reused by later
+    allocations of up to the same class. stb's zlib encoder grows its output buffer and its hash chains
+    by doubling in turns, so most growths move a buffer, the block left behind is taken by the next one.
+
+    reset() drops everything at once between jobs of a long-running caller (pixelhide_bench between
+    cases). The CLI runs one job per process and never resets, its space only comes back through frees.
+
+    When the region can't be reserved or is full, allocations fall back to malloc.
+
+    Page policy:
+        hugePages: allocations of 2 MB or more start on a 2 MB boundary and the memory is advised
+                   with MADV_HUGEPAGE, so a large carrier is mapped with a few hundred page faults.
+        prefault:  pages of those allocations are touched by all the worker threads as soon as they
+                   are allocated, instead of faulting one by one in the thread that first writes them.
+                   Pages stay mapped after reset(), so they are only faulted once per process.
+*/
+
+class Arena{
+
+	public:
+		//must be set before the first allocation
+		static bool hugePages;
+		static bool prefault;
+
+		//malloc/realloc/free semantics, nullptr when out of memory
+		static void* allocate(uint64_t size);
+		static void* reallocate(void* pointer, uint64_t size);
+		static void release(void* pointer);
+
+		//throws instead of returning nullptr
+		static uint8_t* buffer(uint64_t size);
+
+		//drops every allocation in O(1), pages stay mapped for the next job
+		//throws if anything allocated from the arena is still in use
+		static void reset();
+};
+
+#endif
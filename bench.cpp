@@ -0,0 +1,703 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "stb/stb_image.h"
+#include "stb/stb_image_write.h"
+#include "aes.hpp"
+#include "chacha.hpp"
+#include "poly1305.hpp"
+#include "crc32c.hpp"
+#include "coding.hpp"
+#include "wipe.hpp"
+#include "compress.hpp"
+#include "stego.hpp"
+#include "arena.hpp"
+#include "numa.hpp"
+#include "memory.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/*
+    Benchmarks of the hot paths: embedding/extraction kernels, AES CTR, CRC32C, compression,
+    PNG encode/decode and full insert/retrieve.
+
+    Carriers are synthetic (smooth gradient with noise) so runs are reproducible, payloads come in
+    three entropies: zero, text (compressible words) and random.
+    Every case runs 'warmup' times untimed and 'reps' times timed, throughput is computed from the median.
+*/
+
+struct Options{
+    std::vector<double> megapixels = {1};
+    std::vector<int> channels = {1, 2, 3, 4};
+    std::vector<std::string> payloads = {"zero", "text", "random"};
+    double payloadMegabytes = 16;
+    double numaMegabytes = 256;
+    int warmup = 1;
+    int reps = 5;
+    std::string filter;
+    std::string json;
+    std::string baseline;
+    double threshold = 10; //percent slower than the baseline that counts as a regression
+    bool check = false;    //correctness checks instead of the cases
+};
+
+struct Result{
+    std::string name;
+    uint64_t bytes = 0;
+    std::vector<uint64_t> samples; //nanoseconds, sorted
+
+    //nearest rank percentile
+    uint64_t percentile(double p) const{
+        size_t rank = (size_t)std::ceil(p / 100 * samples.size());
+        return samples[std::min(samples.size() - 1, rank == 0 ? 0 : rank - 1)];
+    }
+
+    double megabytesPerSecond() const{
+        return (bytes / 1e6) / (percentile(50) / 1e9);
+    }
+
+    double nanosecondsPerByte() const{
+        return (double)percentile(50) / bytes;
+    }
+};
+
+static Options options;
+static std::vector<Result> results;
+
+//xorshift64, fast and reproducible
+static uint64_t nextRandom(uint64_t &state){
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static void fillRandom(uint8_t* data, uint64_t size, uint64_t seed){
+    uint64_t state = seed;
+
+    uint64_t i = 0;
+    for (; i + 8 <= size; i += 8){
+        uint64_t value = nextRandom(state);
+        std::memcpy(data + i, &value, 8);
+    }
+
+    for (; i < size; i++)
+        data[i] = nextRandom(state) & UINT8_MAX;
+}
+
+static std::vector<uint8_t> makePayload(const std::string &kind, uint64_t size){
+    std::vector<uint8_t> payload(size, 0);
+
+    if(kind == "random"){
+        fillRandom(payload.data(), size, 0x9E3779B97F4A7C15ull);
+    }
+    else if(kind == "text"){
+        static const char* words[] = {"request ", "handled ", "status=200 ", "cache ", "miss ", "user ", "session ", "INFO ", "WARN ", "latency ", "db.pool ", "\n"};
+        uint64_t state = 42;
+
+        for (uint64_t i = 0; i < size;){
+            const char *word = words[nextRandom(state) % 12];
+            for (; *word && i < size; word++)
+                payload[i++] = *word;
+        }
+    }
+
+    return payload;
+}
+
+//smooth gradient with a bit of noise, closer to a photo than pure noise for the PNG codec
+static void fillCarrier(Image &image){
+    uint8_t *data = image.data();
+    uint64_t state = 7;
+
+    for (int y = 0; y < image.height(); y++){
+        uint8_t *row = data + (uint64_t)y * image.width() * image.channels();
+
+        for (int x = 0; x < image.width(); x++)
+            for (int c = 0; c < image.channels(); c++)
+                row[x * image.channels() + c] = ((x + y * (c + 1)) / 8 + (nextRandom(state) & 7)) & UINT8_MAX;
+    }
+}
+
+//appended entries round trip with their own keystream and never decrypt with the one of entry 0, for both ciphers
+static void checkEntries(Key &key){
+    uint8_t cipher = key.cipher(), keySize = key.keySize();
+
+    for (uint8_t entryCipher : {Header::aesCtr, Header::chacha20}){
+        key.useCipher(entryCipher, 32);
+
+        Image image(256, 256, 3, "entries");
+        fillCarrier(image);
+
+        std::vector<std::vector<uint8_t>> payloads;
+        for (uint64_t entry = 0; entry < 3; entry++){
+            payloads.push_back(std::vector<uint8_t>(4096 + entry));
+            fillRandom(payloads.back().data(), payloads.back().size(), entry + 1);
+
+            Memory data = Memory::arena(payloads.back().size());
+            std::copy(payloads.back().begin(), payloads.back().end(), data.data());
+            File file("entry", std::move(data));
+
+            if(entry == 0)
+                insertData(image, file, &key);
+            else
+                appendData(image, file, &key);
+        }
+
+        std::vector<Entry> entries = readEntries(image, &key);
+        if(entries.size() != payloads.size())
+            throw std::runtime_error("Entry check failed: " + std::to_string(entries.size()) + " entries read back.");
+
+        for (uint64_t i = 0; i < entries.size(); i++){
+            std::vector<uint8_t> data(entries[i].header.dataSize);
+            extractData(image, &key, entries[i].header, entries[i].dataIterator, 0, data.size(), data.data());
+
+            if(data != payloads[i])
+                throw std::runtime_error("Entry check failed: entry " + std::to_string(i + 1) + " doesn't round trip.");
+
+            //same stored bytes decrypted with the keystream of entry 0
+            Header first = entries[i].header;
+            first.entry = 0;
+            extractData(image, &key, first, entries[i].dataIterator, 0, data.size(), data.data());
+
+            if(i > 0 && std::equal(data.begin(), data.begin() + 64, payloads[i].begin()))
+                throw std::runtime_error("Entry check failed: entry " + std::to_string(i + 1) + " decrypts with the keystream of entry 0.");
+        }
+
+        //the keystreams of two entries never overlap: for k = 1, 2, 4, block k << 24 of either stream,
+        //where an index in the low counter bytes would land, differs from block 0 of the other
+        withCipher(&key, [&](const auto *data) {
+            for (uint32_t entry : {1, 2, 4}){
+                Header first, later;
+                first.cipher = later.cipher = entryCipher;
+                later.entry = entry;
+
+                uint8_t iv[2][aesBlockSize];
+                entryIv(key.IV(), first, iv[0]);
+                entryIv(key.IV(), later, iv[1]);
+
+                uint64_t gap = (uint64_t)entry << 24 << (entryCipher == Header::chacha20 ? 6 : 4);
+                for (int ahead = 0; ahead < 2; ahead++){
+                    uint8_t counter[aesBlockSize], stream[2][chachaBlockSize] = {};
+                    data->seek(counter, iv[ahead], gap);
+                    data->ctr(counter, stream[0], chachaBlockSize);
+                    data->seek(counter, iv[1 - ahead], 0);
+                    data->ctr(counter, stream[1], chachaBlockSize);
+
+                    if(std::equal(stream[0], stream[0] + chachaBlockSize, stream[1]))
+                        throw std::runtime_error("Entry check failed: entry " + std::to_string(entry + 1) + " shares the keystream of entry 0.");
+                }
+            }
+        });
+    }
+
+    key.useCipher(cipher, keySize);
+}
+
+static bool selected(const std::string &name){
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+//setup runs before every repetition and is not timed
+static void measure(const std::string &name, uint64_t bytes, std::function<void()> setup, std::function<void()> run){
+    if(!selected(name))
+        return;
+
+    for (int i = 0; i < options.warmup; i++){
+        setup();
+        run();
+    }
+
+    Result result;
+    result.name = name;
+    result.bytes = bytes;
+
+    for (int i = 0; i < options.reps; i++){
+        setup();
+
+        uint64_t start = Stats::now();
+        run();
+        result.samples.push_back(Stats::now() - start);
+    }
+
+    std::sort(result.samples.begin(), result.samples.end());
+
+    std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(12) << result.percentile(0) / 1e6 << std::setw(12) << result.percentile(50) / 1e6
+              << std::setw(12) << result.percentile(90) / 1e6 << std::setw(12) << result.percentile(99) / 1e6
+              << std::setw(11) << std::setprecision(1) << result.megabytesPerSecond()
+              << std::setw(10) << std::setprecision(3) << result.nanosecondsPerByte() << std::endl;
+
+    results.push_back(result);
+}
+
+//IV followed by a 32 byte key, so every AES key size can be taken from it
+static void writeKey(const std::filesystem::path &path){
+    uint8_t data[48];
+    fillRandom(data, sizeof(data), 1234);
+
+    std::ofstream fout(path, std::ios::binary);
+    fout.write(reinterpret_cast<char*>(data), sizeof(data));
+}
+
+static void pngWriter(void* context, void* data, int size){
+    std::vector<uint8_t> *png = static_cast<std::vector<uint8_t>*>(context);
+    png->insert(png->end(), static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
+}
+
+//payload independent cases for one carrier
+static void benchCarrier(int channels, double megapixels, Key &key){
+    int width = (int)std::lround(std::sqrt(megapixels * 1e6));
+    int height = width;
+
+    std::ostringstream suffix;
+    suffix << "/c" << channels << '/' << megapixels << "MP";
+
+    Image image(width, height, channels, "bench");
+    fillCarrier(image);
+
+    Header capacity;
+    capacity.chunkSize = crcChunkSize;
+    uint64_t payloadSize = availableBytes(image, capacity); //fills the carrier at 1 LSB
+
+    std::vector<uint8_t> payload = makePayload("random", payloadSize);
+    std::vector<uint8_t> buffer(payloadSize);
+    MatchNoise noise(key.key());
+
+    for (uint8_t mode = 1; mode <= Header::maxMode; mode++){
+        uint64_t size = payloadSize * mode / Header::maxMode; //same carrier bytes touched for every mode
+        std::string name = "mode" + std::to_string(mode) + suffix.str();
+
+        measure("insertChunk/" + name, size, []{}, [&]{ insertChunk(image.data(), 0, payload.data(), size, mode, channels); });
+        measure("retrieveChunk/" + name, size, []{}, [&]{ retrieveChunk(image.data(), 0, buffer.data(), size, mode, channels); });
+        measure("matchChunk/" + name, size, []{}, [&]{ matchChunk(image.data(), 0, payload.data(), size, mode, channels, noise, 0); });
+    }
+
+    for (uint8_t keySize : {16, 24, 32}){
+        AesCipher cipher = makeAesCipher(key.key(), keySize);
+
+        measure("aes" + std::to_string(keySize * 8) + "_ctr" + suffix.str(), payloadSize, []{}, [&]{
+            std::visit([&](const auto &aes) {
+                uint8_t counter[aesBlockSize];
+                std::copy_n(key.IV(), aesBlockSize, counter);
+                aes.ctr(counter, buffer.data(), payloadSize);
+            }, cipher);
+        });
+    }
+
+    {
+        ChaCha20<32> chacha(key.key());
+
+        measure("chacha20_ctr" + suffix.str(), payloadSize, []{}, [&]{
+            uint8_t counter[aesBlockSize];
+            chacha.seek(counter, key.IV(), 0);
+            chacha.ctr(counter, buffer.data(), payloadSize);
+        });
+    }
+
+    measure("poly1305" + suffix.str(), payloadSize, []{}, [&]{
+        uint8_t tag[poly1305TagSize];
+        Poly1305 mac(key.key());
+        mac.update(payload.data(), payloadSize);
+        mac.finish(tag);
+    });
+
+    measure("crc32c" + suffix.str(), payloadSize, []{}, [&]{ crc32c(payload.data(), payloadSize); });
+
+    //syndrome coding of one segment, per data byte, the cover LSBs are taken from the carrier
+    std::vector<uint8_t> lsbs(std::max(stcSlots(codingSegment, stcMinWidth), hammingSlots(codingSegment, 3)));
+    for (uint64_t i = 0; i < lsbs.size(); i++)
+        lsbs[i] = image.data()[i] & 1;
+
+    measure("hamming_embed/k3" + suffix.str(), codingSegment, []{}, [&]{ hammingEmbed(lsbs.data(), payload.data(), codingSegment, 3); });
+    measure("stc_embed/w2" + suffix.str(), codingSegment, []{}, [&]{ stcEmbed(lsbs.data(), nullptr, payload.data(), codingSegment, stcMinWidth); });
+    measure("stc_extract/w2" + suffix.str(), codingSegment, []{}, [&]{ stcExtract(lsbs.data(), buffer.data(), codingSegment, stcMinWidth); });
+
+    //adaptive cost map, per carrier byte: histogram pass for the threshold and the selection bitmap
+    {
+        CostMap costs(image, 1);
+        uint8_t threshold = adaptiveThreshold(costs, 0, image.size_no_alpha() / 2);
+
+        measure("adaptive_threshold" + suffix.str(), image.size(), []{}, [&]{ adaptiveThreshold(costs, 0, image.size_no_alpha() / 2); });
+        measure("adaptive_selection" + suffix.str(), image.size(), []{}, [&]{ Selection selection(costs, 0, threshold); });
+    }
+
+    //full insert and retrieve with encryption, the payload is encrypted in place so a fresh copy is made every time
+    std::unique_ptr<File> file;
+    auto freshFile = [&]{
+        file.reset(); //the previous file is the last allocation, so the arena takes its space back
+        Memory data = Memory::arena(payloadSize);
+        std::copy(payload.begin(), payload.end() - 5, data.data());
+        std::copy_n("\0nib.", 5, data.data() + payloadSize - 5); //".bin" extension stored in reverse
+        file = std::make_unique<File>("bench", std::move(data));
+    };
+
+    measure("insert" + suffix.str(), payloadSize, freshFile, [&]{ insertData(image, *file, &key); });
+
+    if(selected("retrieve" + suffix.str())){
+        freshFile();
+        insertData(image, *file, &key);
+    }
+
+    measure("retrieve" + suffix.str(), payloadSize, []{}, [&]{
+        Header header;
+        uint64_t dataIterator = 0;
+
+        if(readHeader(image, &key, header, dataIterator))
+            extractData(image, &key, header, dataIterator, 0, header.dataSize, buffer.data());
+    });
+
+    //one changed byte: the old data is extracted and compared, only its chunk is embedded again
+    measure("update" + suffix.str(), payloadSize, [&]{
+        freshFile();
+        insertData(image, *file, &key);
+        freshFile();
+        file->data()[payloadSize / 2] ^= 1;
+    }, [&]{ updateData(image, *file, &key); });
+
+    //scattered layouts, random channel access over the whole image against cache-sized tiles
+    for (auto [layout, name] : {std::pair<uint8_t, const char*>{Header::scatter, "insert_scatter"}, {Header::tiled, "insert_tiled"}}){
+        InsertOptions scatterOptions;
+        scatterOptions.layout = layout;
+        measure(name + suffix.str(), payloadSize, freshFile, [&]{ insertData(image, *file, &key, scatterOptions); });
+    }
+
+    //region of interest, the middle half of the columns below the header rows, so the same payload takes 3 LSBs
+    InsertOptions roiOptions;
+    roiOptions.roi = {(uint32_t)width / 4, 16, (uint32_t)width / 2, (uint32_t)height - 16};
+    measure("insert_roi" + suffix.str(), payloadSize, freshFile, [&]{ insertData(image, *file, &key, roiOptions); });
+
+    InsertOptions adaptiveOptions;
+    adaptiveOptions.adaptive = true;
+    measure("insert_adaptive" + suffix.str(), payloadSize, freshFile, [&]{ insertData(image, *file, &key, adaptiveOptions); });
+
+    //LSB wipe of the whole carrier, randomized and cleared
+    measure("wipe" + suffix.str(), image.size(), []{}, [&]{ wipePlanes(image, 0, image.size(), 1, false); });
+    measure("wipe_zero" + suffix.str(), image.size(), []{}, [&]{ wipePlanes(image, 0, image.size(), 1, true); });
+
+    std::vector<uint8_t> png;
+    measure("png_encode" + suffix.str(), image.size(), [&]{ png.clear(); }, [&]{
+        stbi_write_png_to_func(pngWriter, &png, width, height, channels, image.data(), width * channels);
+    });
+
+    if(png.empty())
+        stbi_write_png_to_func(pngWriter, &png, width, height, channels, image.data(), width * channels);
+
+    measure("png_decode" + suffix.str(), image.size(), []{}, [&]{
+        int w, h, c;
+        stbi_image_free(stbi_load_from_memory(png.data(), png.size(), &w, &h, &c, 0));
+    });
+}
+
+//cases that depend on the payload entropy
+static void benchPayload(const std::string &kind){
+    uint64_t size = (uint64_t)(options.payloadMegabytes * 1e6);
+    std::vector<uint8_t> payload = makePayload(kind, size);
+
+    Header header;
+    std::vector<uint8_t> compressed;
+
+    measure("compress/" + kind, size, [&]{ header = Header(); }, [&]{ compressed = compressData(payload.data(), size, header); });
+
+    if(compressed.empty())
+        compressed = compressData(payload.data(), size, header);
+
+    std::vector<uint8_t> buffer(size);
+    measure("decompress/" + kind, size, []{}, [&]{ decompressData(header, 0, header.blockCount(), compressed.data(), buffer.data()); });
+}
+
+//cross-node penalty: the same embedding over a carrier first touched by one thread (every page on its node)
+//and over one first touched by the workers that embed it, threads are pinned in both cases
+static void benchNuma(){
+    uint64_t carrierSize = (uint64_t)(options.numaMegabytes * 1e6) / 4 * 4;
+    uint64_t payloadSize = carrierSize / 4; //2 LSBs of 3 channels
+
+    std::string suffix = "/" + std::to_string(carrierSize >> 20) + "MB/" + std::to_string(numaNodes()) + "nodes";
+    std::string remote = "numa/first_touch_main" + suffix, local = "numa/first_touch_workers" + suffix;
+    if(!selected(remote) && !selected(local))
+        return;
+
+    std::vector<uint8_t> payload = makePayload("random", payloadSize);
+    Memory carrier;
+
+    //fresh pages every time
+    auto allocate = [&]{
+#if defined(__linux__)
+        void *pages = mmap(nullptr, carrierSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        carrier = pages == MAP_FAILED ? Memory() : Memory::mapped(pages, carrierSize);
+#else
+        carrier = Memory(static_cast<uint8_t*>(std::malloc(carrierSize)), carrierSize, [](uint8_t* data, uint64_t) { std::free(data); });
+#endif
+        if(!carrier)
+            throw std::runtime_error("Could not allocate the NUMA carrier.");
+    };
+
+    auto embed = [&]{
+        runParallel(payloadSize, 1, [&](uint64_t offset, uint64_t size) {
+            insertChunk(carrier.data(), offset * 4, payload.data() + offset, size, 2, 3);
+        });
+    };
+
+    Numa mode = numaMode;
+    numaMode = Numa::local;
+
+    //the main thread is pinned only while the pages are touched
+    measure(remote, payloadSize, [&]{
+        allocate();
+        PartPin pin(0, numThreads);
+        std::memset(carrier.data(), 0, carrierSize);
+    }, embed);
+
+    measure(local, payloadSize, [&]{
+        allocate();
+        runParallel(carrierSize, 4, [&](uint64_t offset, uint64_t size) { std::memset(carrier.data() + offset, 0, size); });
+    }, embed);
+
+    numaMode = mode;
+}
+
+//reads name and p50 of every result from a JSON written by this benchmark
+static std::map<std::string, double> readBaseline(const std::string &path){
+    std::ifstream fin(path);
+    if(!fin)
+        throw std::runtime_error("Could not open baseline: \"" + path + '\"');
+
+    std::map<std::string, double> baseline;
+    std::string line;
+
+    while (std::getline(fin, line)){
+        size_t name = line.find("\"name\": \"");
+        size_t p50 = line.find("\"p50_ns\": ");
+        if(name == std::string::npos || p50 == std::string::npos)
+            continue;
+
+        name += 9;
+        baseline[line.substr(name, line.find('"', name) - name)] = std::stod(line.substr(p50 + 10));
+    }
+
+    return baseline;
+}
+
+static void writeJson(const std::string &path){
+    std::ofstream fout(path);
+    if(!fout)
+        throw std::runtime_error("Failed to create file: " + path);
+
+    fout << std::fixed << std::setprecision(3);
+    fout << "{\n  \"threads\": " << numThreads << ",\n  \"reps\": " << options.reps << ",\n  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); i++){
+        const Result &result = results[i];
+
+        fout << (i == 0 ? "\n" : ",\n")
+             << "    {\"name\": \"" << result.name << "\", \"bytes\": " << result.bytes
+             << ", \"min_ns\": " << result.percentile(0) << ", \"p50_ns\": " << result.percentile(50)
+             << ", \"p90_ns\": " << result.percentile(90) << ", \"p99_ns\": " << result.percentile(99)
+             << ", \"max_ns\": " << result.percentile(100) << ", \"mb_per_s\": " << result.megabytesPerSecond()
+             << ", \"ns_per_byte\": " << result.nanosecondsPerByte() << '}';
+    }
+
+    fout << "\n  ]\n}\n";
+}
+
+//returns the number of regressions
+static int compareBaseline(const std::string &path){
+    std::map<std::string, double> baseline = readBaseline(path);
+    int regressions = 0;
+
+    std::cout << "\nComparison with " << path << " (median):\n";
+    std::cout << std::left << std::setw(40) << "Case" << std::right << std::setw(14) << "Baseline ms" << std::setw(12) << "Now ms" << std::setw(10) << "Change" << '\n';
+
+    for (const Result &result : results){
+        auto it = baseline.find(result.name);
+        if(it == baseline.end())
+            continue;
+
+        double change = (result.percentile(50) - it->second) / it->second * 100;
+        bool regression = change > options.threshold;
+        regressions += regression;
+
+        std::cout << std::left << std::setw(40) << result.name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(14) << it->second / 1e6 << std::setw(12) << result.percentile(50) / 1e6
+                  << std::setw(9) << std::setprecision(1) << std::showpos << change << std::noshowpos << '%'
+                  << (regression ? "  REGRESSION" : "") << '\n';
+    }
+
+    return regressions;
+}
+
+template<typename T>
+static std::vector<T> parseList(const std::string &list){
+    std::vector<T> values;
+    std::stringstream stream(list);
+    std::string item;
+
+    while (std::getline(stream, item, ',')){
+        std::stringstream itemStream(item);
+        T value;
+        if(!(itemStream >> value))
+            throw std::runtime_error("Invalid list: \"" + list + '\"');
+
+        values.push_back(value);
+    }
+
+    return values;
+}
+
+static void printHelp(char* program) {
+    std::string progName = std::filesystem::path(program).stem().string();
+
+    std::cout << "\nUsage:\n";
+    std::cout << "  ./" << progName << " [options]\n\n";
+
+    std::cout << "Options:\n";
+    std::cout << "  --megapixels <list>   Carrier sizes in megapixels, e.g. 1,16,500 (default 1).\n";
+    std::cout << "  --channels <list>     Carrier channels, e.g. 3,4 (default 1,2,3,4).\n";
+    std::cout << "  --payloads <list>     Payload entropies from zero,text,random (default all).\n";
+    std::cout << "  --payload-mb <n>      Payload size for compression cases (default 16).\n";
+    std::cout << "  --numa-mb <n>         Carrier size for the NUMA first touch cases (default 256).\n";
+    std::cout << "  --warmup <n>          Untimed runs of every case (default 1).\n";
+    std::cout << "  --reps <n>            Timed runs of every case (default 5).\n";
+    std::cout << "  --threads <n>         Threads for full insert/retrieve (default all cores).\n";
+    std::cout << "  --prefault            Map the pages of large buffers on all threads when they are allocated.\n";
+    std::cout << "  --no-hugepages        Don't align large buffers to 2 MB or advise huge pages for them.\n";
+    std::cout << "  --numa <mode>         NUMA placement for all cases: off, local or interleave (default off).\n";
+    std::cout << "  --filter <text>       Only run cases whose name contains <text>.\n";
+    std::cout << "  --json <file>         Save results as JSON, can be used as a baseline later.\n";
+    std::cout << "  --baseline <file>     Compare with a saved JSON, exits with 1 on regressions.\n";
+    std::cout << "  --threshold <percent> Slowdown reported as a regression (default 10).\n";
+    std::cout << "  --check               Only run the correctness checks (keystreams of appended entries), exits with 1 on failure.\n\n";
+
+    std::cout << "Examples:\n";
+    std::cout << "  ./" << progName << " --channels 3,4 --megapixels 1,16 --json baseline.json\n";
+    std::cout << "  ./" << progName << " --channels 3,4 --megapixels 1,16 --baseline baseline.json\n\n";
+}
+
+int main(int argc, char* argv[]) {
+
+    try {
+        for (int i = 1; i < argc; i++){
+            std::string arg(argv[i]);
+
+            if(arg == "-h" || arg == "--help"){
+                printHelp(argv[0]);
+                return 0;
+            }
+
+            if(arg == "--prefault"){
+                Arena::prefault = true;
+                continue;
+            }
+
+            if(arg == "--no-hugepages"){
+                Arena::hugePages = false;
+                continue;
+            }
+
+            if(arg == "--check"){
+                options.check = true;
+                continue;
+            }
+
+            if(i + 1 == argc)
+                throw std::runtime_error("Missing value for " + arg + ". Use -h for help.");
+
+            std::string value(argv[++i]);
+
+            if(arg == "--megapixels")
+                options.megapixels = parseList<double>(value);
+            else if(arg == "--channels")
+                options.channels = parseList<int>(value);
+            else if(arg == "--payloads")
+                options.payloads = parseList<std::string>(value);
+            else if(arg == "--payload-mb")
+                options.payloadMegabytes = std::stod(value);
+            else if(arg == "--numa-mb")
+                options.numaMegabytes = std::stod(value);
+            else if(arg == "--numa"){
+                if(value == "local")
+                    numaMode = Numa::local;
+                else if(value == "interleave")
+                    numaMode = Numa::interleave;
+                else if(value != "off")
+                    throw std::runtime_error("Invalid NUMA mode \"" + value + "\", expected off, local or interleave.");
+            }
+            else if(arg == "--warmup")
+                options.warmup = std::stoi(value);
+            else if(arg == "--reps")
+                options.reps = std::max(1, std::stoi(value));
+            else if(arg == "--threads")
+                numThreads = std::stoul(value);
+            else if(arg == "--filter")
+                options.filter = value;
+            else if(arg == "--json")
+                options.json = value;
+            else if(arg == "--baseline")
+                options.baseline = value;
+            else if(arg == "--threshold")
+                options.threshold = std::stod(value);
+            else
+                throw std::runtime_error("Unknown option " + arg + ". Use -h for help.");
+        }
+
+        if (numThreads == 0)
+            numThreads = 1;
+
+        std::filesystem::path keyPath = std::filesystem::temp_directory_path() / "pixelhide_bench.key";
+        writeKey(keyPath);
+        Key key(keyPath.string().c_str());
+
+        if (options.check){
+            checkEntries(key);
+            std::filesystem::remove(keyPath);
+
+            std::cout << "All checks passed\n";
+            return 0;
+        }
+
+        std::cout << std::left << std::setw(40) << "Case" << std::right << std::setw(12) << "Min ms" << std::setw(12) << "P50 ms"
+                  << std::setw(12) << "P90 ms" << std::setw(12) << "P99 ms" << std::setw(11) << "MB/s" << std::setw(10) << "ns/B" << '\n';
+
+        //every carrier is a job, its buffers are dropped together
+        for (double megapixels : options.megapixels){
+            for (int channels : options.channels){
+                benchCarrier(channels, megapixels, key);
+                Arena::reset();
+            }
+        }
+
+        for (const std::string &kind : options.payloads)
+            benchPayload(kind);
+
+        benchNuma();
+
+        std::filesystem::remove(keyPath);
+
+        if (!options.json.empty())
+            writeJson(options.json);
+
+        if (!options.baseline.empty() && compareBaseline(options.baseline) > 0)
+            return 1;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
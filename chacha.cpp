@@ -0,0 +1,277 @@
+#include "chacha.hpp"
+
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #include <immintrin.h>
+    #define CHACHA_SIMD 1
+#endif
+
+static inline uint32_t load(const uint8_t* data){
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static inline void store(uint8_t* data, uint32_t value){
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+static inline void setCounter(uint32_t* input, uint64_t block){
+    input[12] = (uint32_t)block;
+    input[13] = (uint32_t)(block >> 32);
+}
+
+//one block at a time
+
+static inline uint32_t rotate(uint32_t x, int bits){
+    return (x << bits) | (x >> (32 - bits));
+}
+
+static inline void quarterRound(uint32_t &a, uint32_t &b, uint32_t &c, uint32_t &d){
+    a += b; d = rotate(d ^ a, 16);
+    c += d; b = rotate(b ^ c, 12);
+    a += b; d = rotate(d ^ a, 8);
+    c += d; b = rotate(b ^ c, 7);
+}
+
+static void keystreamBlock(const uint32_t* input, uint8_t* keystream){
+    uint32_t x[16];
+    std::memcpy(x, input, sizeof(x));
+
+    for (int round = 0; round < ChaCha20<32>::rounds; round += 2){
+        quarterRound(x[0], x[4], x[8], x[12]);
+        quarterRound(x[1], x[5], x[9], x[13]);
+        quarterRound(x[2], x[6], x[10], x[14]);
+        quarterRound(x[3], x[7], x[11], x[15]);
+
+        quarterRound(x[0], x[5], x[10], x[15]);
+        quarterRound(x[1], x[6], x[11], x[12]);
+        quarterRound(x[2], x[7], x[8], x[13]);
+        quarterRound(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i++)
+        store(keystream + i * 4, x[i] + input[i]);
+}
+
+#ifdef CHACHA_SIMD
+
+//4 blocks with SSE2, register i holds word i of every block
+
+template<int Bits>
+static inline __m128i rotate(__m128i x){
+    return _mm_or_si128(_mm_slli_epi32(x, Bits), _mm_srli_epi32(x, 32 - Bits));
+}
+
+static inline void quarterRound(__m128i &a, __m128i &b, __m128i &c, __m128i &d){
+    a = _mm_add_epi32(a, b); d = rotate<16>(_mm_xor_si128(d, a));
+    c = _mm_add_epi32(c, d); b = rotate<12>(_mm_xor_si128(b, c));
+    a = _mm_add_epi32(a, b); d = rotate<8>(_mm_xor_si128(d, a));
+    c = _mm_add_epi32(c, d); b = rotate<7>(_mm_xor_si128(b, c));
+}
+
+static void xorBlocks4(const uint32_t* input, uint8_t* data){
+    __m128i x[16], start[16];
+
+    for (int i = 0; i < 16; i++)
+        start[i] = _mm_set1_epi32(input[i]);
+
+    uint64_t block = input[12] | (uint64_t)input[13] << 32;
+    start[12] = _mm_setr_epi32(block, block + 1, block + 2, block + 3);
+    start[13] = _mm_setr_epi32(block >> 32, (block + 1) >> 32, (block + 2) >> 32, (block + 3) >> 32);
+
+    std::memcpy(x, start, sizeof(x));
+
+    for (int round = 0; round < ChaCha20<32>::rounds; round += 2){
+        quarterRound(x[0], x[4], x[8], x[12]);
+        quarterRound(x[1], x[5], x[9], x[13]);
+        quarterRound(x[2], x[6], x[10], x[14]);
+        quarterRound(x[3], x[7], x[11], x[15]);
+
+        quarterRound(x[0], x[5], x[10], x[15]);
+        quarterRound(x[1], x[6], x[11], x[12]);
+        quarterRound(x[2], x[7], x[8], x[13]);
+        quarterRound(x[3], x[4], x[9], x[14]);
+    }
+
+    //transposing every 4 words back to 16 bytes of each block
+    for (int i = 0; i < 16; i += 4){
+        __m128i a = _mm_add_epi32(x[i], start[i]), b = _mm_add_epi32(x[i + 1], start[i + 1]);
+        __m128i c = _mm_add_epi32(x[i + 2], start[i + 2]), d = _mm_add_epi32(x[i + 3], start[i + 3]);
+
+        __m128i ab0 = _mm_unpacklo_epi32(a, b), cd0 = _mm_unpacklo_epi32(c, d);
+        __m128i ab1 = _mm_unpackhi_epi32(a, b), cd1 = _mm_unpackhi_epi32(c, d);
+
+        __m128i rows[4] = {
+            _mm_unpacklo_epi64(ab0, cd0), _mm_unpackhi_epi64(ab0, cd0),
+            _mm_unpacklo_epi64(ab1, cd1), _mm_unpackhi_epi64(ab1, cd1)
+        };
+
+        for (int j = 0; j < 4; j++){
+            __m128i *out = reinterpret_cast<__m128i*>(data + j * chachaBlockSize + i * 4);
+            _mm_storeu_si128(out, _mm_xor_si128(_mm_loadu_si128(out), rows[j]));
+        }
+    }
+}
+
+//8 blocks with AVX2, lanes 0-3 in the low half of every register and 4-7 in the high half
+
+template<int Bits>
+__attribute__((target("avx2")))
+static inline __m256i rotate(__m256i x){
+    if constexpr (Bits == 16)
+        return _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, 2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13));
+    else if constexpr (Bits == 8)
+        return _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14, 3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14));
+    else
+        return _mm256_or_si256(_mm256_slli_epi32(x, Bits), _mm256_srli_epi32(x, 32 - Bits));
+}
+
+__attribute__((target("avx2")))
+static inline void quarterRound(__m256i &a, __m256i &b, __m256i &c, __m256i &d){
+    a = _mm256_add_epi32(a, b); d = rotate<16>(_mm256_xor_si256(d, a));
+    c = _mm256_add_epi32(c, d); b = rotate<12>(_mm256_xor_si256(b, c));
+    a = _mm256_add_epi32(a, b); d = rotate<8>(_mm256_xor_si256(d, a));
+    c = _mm256_add_epi32(c, d); b = rotate<7>(_mm256_xor_si256(b, c));
+}
+
+__attribute__((target("avx2")))
+static void xorBlocks8(const uint32_t* input, uint8_t* data){
+    __m256i x[16], start[16];
+
+    for (int i = 0; i < 16; i++)
+        start[i] = _mm256_set1_epi32(input[i]);
+
+    uint64_t block = input[12] | (uint64_t)input[13] << 32;
+    uint32_t low[8], high[8];
+    for (int i = 0; i < 8; i++){
+        low[i] = (uint32_t)(block + i);
+        high[i] = (uint32_t)((block + i) >> 32);
+    }
+    start[12] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(low));
+    start[13] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(high));
+
+    std::memcpy(x, start, sizeof(x));
+
+    for (int round = 0; round < ChaCha20<32>::rounds; round += 2){
+        quarterRound(x[0], x[4], x[8], x[12]);
+        quarterRound(x[1], x[5], x[9], x[13]);
+        quarterRound(x[2], x[6], x[10], x[14]);
+        quarterRound(x[3], x[7], x[11], x[15]);
+
+        quarterRound(x[0], x[5], x[10], x[15]);
+        quarterRound(x[1], x[6], x[11], x[12]);
+        quarterRound(x[2], x[7], x[8], x[13]);
+        quarterRound(x[3], x[4], x[9], x[14]);
+    }
+
+    //rows[i / 4][j]: words i to i + 3 of block j (low half) and block j + 4 (high half)
+    __m256i rows[4][4];
+    for (int i = 0; i < 16; i += 4){
+        __m256i a = _mm256_add_epi32(x[i], start[i]), b = _mm256_add_epi32(x[i + 1], start[i + 1]);
+        __m256i c = _mm256_add_epi32(x[i + 2], start[i + 2]), d = _mm256_add_epi32(x[i + 3], start[i + 3]);
+
+        __m256i ab0 = _mm256_unpacklo_epi32(a, b), cd0 = _mm256_unpacklo_epi32(c, d);
+        __m256i ab1 = _mm256_unpackhi_epi32(a, b), cd1 = _mm256_unpackhi_epi32(c, d);
+
+        rows[i / 4][0] = _mm256_unpacklo_epi64(ab0, cd0);
+        rows[i / 4][1] = _mm256_unpackhi_epi64(ab0, cd0);
+        rows[i / 4][2] = _mm256_unpacklo_epi64(ab1, cd1);
+        rows[i / 4][3] = _mm256_unpackhi_epi64(ab1, cd1);
+    }
+
+    for (int j = 0; j < 4; j++){
+        __m256i keystream[4] = {
+            _mm256_permute2x128_si256(rows[0][j], rows[1][j], 0x20), //block j, bytes 0-31
+            _mm256_permute2x128_si256(rows[2][j], rows[3][j], 0x20), //block j, bytes 32-63
+            _mm256_permute2x128_si256(rows[0][j], rows[1][j], 0x31), //block j + 4, bytes 0-31
+            _mm256_permute2x128_si256(rows[2][j], rows[3][j], 0x31)  //block j + 4, bytes 32-63
+        };
+
+        __m256i *out[4] = {
+            reinterpret_cast<__m256i*>(data + j * chachaBlockSize),
+            reinterpret_cast<__m256i*>(data + j * chachaBlockSize + 32),
+            reinterpret_cast<__m256i*>(data + (j + 4) * chachaBlockSize),
+            reinterpret_cast<__m256i*>(data + (j + 4) * chachaBlockSize + 32)
+        };
+
+        for (int k = 0; k < 4; k++)
+            _mm256_storeu_si256(out[k], _mm256_xor_si256(_mm256_loadu_si256(out[k]), keystream[k]));
+    }
+}
+
+#endif
+
+template<int KeySize>
+ChaCha20<KeySize>::ChaCha20(const uint8_t* key){
+    //"expand 32-byte k" or "expand 16-byte k", a 16 byte key is used twice
+    const char *constant = KeySize == 32 ? "expand 32-byte k" : "expand 16-byte k";
+
+    for (int i = 0; i < 4; i++)
+        state_[i] = load(reinterpret_cast<const uint8_t*>(constant) + i * 4);
+
+    for (int i = 0; i < 8; i++)
+        state_[4 + i] = load(key + (i * 4) % KeySize);
+}
+
+template<int KeySize>
+ChaCha20<KeySize>::~ChaCha20(){
+    volatile uint32_t *words = state_;
+    for (size_t i = 0; i < sizeof(state_) / sizeof(uint32_t); i++)
+        words[i] = 0;
+}
+
+template<int KeySize>
+void ChaCha20<KeySize>::ctr(uint8_t* counter, uint8_t* data, uint64_t size) const{
+    uint32_t input[16];
+    std::memcpy(input, state_, sizeof(state_));
+    for (int i = 0; i < 4; i++)
+        input[12 + i] = load(counter + i * 4);
+
+    uint64_t block = input[12] | (uint64_t)input[13] << 32;
+
+#ifdef CHACHA_SIMD
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+
+    if(avx2){
+        for (; size >= 8 * chachaBlockSize; size -= 8 * chachaBlockSize, data += 8 * chachaBlockSize){
+            xorBlocks8(input, data);
+            setCounter(input, block += 8);
+        }
+    }
+
+    for (; size >= 4 * chachaBlockSize; size -= 4 * chachaBlockSize, data += 4 * chachaBlockSize){
+        xorBlocks4(input, data);
+        setCounter(input, block += 4);
+    }
+#endif
+
+    uint8_t keystream[chachaBlockSize];
+    for (; size > 0; data += chachaBlockSize){
+        keystreamBlock(input, keystream);
+        setCounter(input, ++block);
+
+        uint64_t length = size < chachaBlockSize ? size : chachaBlockSize;
+        for (uint64_t i = 0; i < length; i++)
+            data[i] ^= keystream[i];
+
+        size -= length;
+    }
+
+    store(counter, input[12]);
+    store(counter + 4, input[13]);
+}
+
+template<int KeySize>
+void ChaCha20<KeySize>::seek(uint8_t* counter, const uint8_t* iv, uint64_t position){
+    std::memcpy(counter + 8, iv + 8, 8);
+
+    uint64_t block = (load(iv) | (uint64_t)load(iv + 4) << 32) + position / chachaBlockSize;
+    store(counter, (uint32_t)block);
+    store(counter + 4, (uint32_t)(block >> 32));
+}
+
+template class ChaCha20<16>;
+template class ChaCha20<32>;
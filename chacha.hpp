@@ -0,0 +1,42 @@
+#ifndef CHACHA_HPP
+#define CHACHA_HPP
+
+#include <cstdint>
+
+inline constexpr uint64_t chachaBlockSize = 64; //keystream bytes per counter value
+
+/*
+    ChaCha20 stream cipher with a 16 or 32 byte key (original variant: 64-bit block counter, 64-bit nonce).
+    The 16 byte counter block is laid out like the last 4 words of the state and the IV is its initial value:
+        bytes 0-7:  block counter, little endian
+        bytes 8-15: nonce
+    so the counter of any byte of the stream is computed directly with seek().
+
+    Blocks are generated 8 at a time with AVX2 or 4 at a time with SSE2 when the cpu has them,
+    the tail of a call is generated one block at a time.
+*/
+
+template<int KeySize>
+class ChaCha20{
+
+	static_assert(KeySize == 16 || KeySize == 32, "ChaCha20 keys are 16 or 32 bytes");
+
+	public:
+		static constexpr int keySize = KeySize;
+		static constexpr int rounds = 20;
+
+	private:
+		uint32_t state_[12]; //constants and key, the rest of the state is the counter block
+
+	public:
+		explicit ChaCha20(const uint8_t* key);
+		~ChaCha20(); //key words are zeroized
+
+		//xors the keystream starting at 'counter' into data, 'counter' is advanced past the last block
+		void ctr(uint8_t* counter, uint8_t* data, uint64_t size) const;
+
+		//counter block of byte 'position' (a multiple of chachaBlockSize) of a stream that starts at 'iv'
+		static void seek(uint8_t* counter, const uint8_t* iv, uint64_t position);
+};
+
+#endif
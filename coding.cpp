@@ -0,0 +1,288 @@
+#include "coding.hpp"
+
+#include <utility>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #include <immintrin.h>
+    #define CODING_SIMD 1
+#endif
+
+static constexpr uint32_t stcStates = 1 << stcHeight;
+
+static inline uint8_t dataBit(const uint8_t* data, uint64_t bit){
+    return (data[bit / 8] >> (bit % 8)) & 1;
+}
+
+//Hamming
+
+uint64_t hammingSlots(uint64_t bytes, uint8_t k){
+    return (bytes * 8 + k - 1) / k * ((1u << k) - 1);
+}
+
+static inline uint32_t hammingSyndrome(const uint8_t* lsbs, uint32_t n){
+    uint32_t syndrome = 0;
+    for (uint32_t i = 0; i < n; i++)
+        syndrome ^= (i + 1) & -(uint32_t)lsbs[i];
+
+    return syndrome;
+}
+
+void hammingEmbed(uint8_t* lsbs, const uint8_t* data, uint64_t bytes, uint8_t k){
+    uint32_t n = (1u << k) - 1;
+    uint64_t bits = bytes * 8;
+
+    for (uint64_t bit = 0; bit < bits; bit += k, lsbs += n){
+        uint32_t message = 0;
+        for (uint8_t j = 0; j < k && bit + j < bits; j++)
+            message |= dataBit(data, bit + j) << j;
+
+        uint32_t difference = hammingSyndrome(lsbs, n) ^ message;
+        if(difference != 0)
+            lsbs[difference - 1] ^= 1;
+    }
+}
+
+void hammingExtract(const uint8_t* lsbs, uint8_t* data, uint64_t bytes, uint8_t k){
+    uint32_t n = (1u << k) - 1;
+    uint64_t bits = bytes * 8;
+
+    for (uint64_t i = 0; i < bytes; i++)
+        data[i] = 0;
+
+    for (uint64_t bit = 0; bit < bits; bit += k, lsbs += n){
+        uint32_t message = hammingSyndrome(lsbs, n);
+        for (uint8_t j = 0; j < k && bit + j < bits; j++)
+            data[(bit + j) / 8] |= ((message >> j) & 1) << ((bit + j) % 8);
+    }
+}
+
+//STC
+
+uint64_t stcSlots(uint64_t bytes, uint8_t width){
+    return bytes * 8 * width;
+}
+
+//fixed submatrix for a width, the first and last rows are all 1 so every channel changes the current data bit
+//and every state can be left in one step
+static void stcColumns(uint8_t width, uint8_t* columns){
+    uint64_t state = 0x5354430000000000 | width;
+
+    for (uint8_t j = 0; j < width; j++){
+        state += 0x9e3779b97f4a7c15;
+        uint64_t x = state;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+        x ^= x >> 31;
+
+        columns[j] = (x & (stcStates - 1)) | 1 | (1 << (stcHeight - 1));
+    }
+}
+
+void stcExtract(const uint8_t* lsbs, uint8_t* data, uint64_t bytes, uint8_t width){
+    uint8_t columns[stcMaxWidth];
+    stcColumns(width, columns);
+
+    uint32_t state = 0;
+    for (uint64_t i = 0; i < bytes; i++){
+        uint8_t byte = 0;
+
+        for (int bit = 0; bit < 8; bit++){
+            for (uint8_t j = 0; j < width; j++, lsbs++)
+                state ^= columns[j] & -(uint32_t)*lsbs;
+
+            byte |= (state & 1) << bit;
+            state >>= 1;
+        }
+
+        data[i] = byte;
+    }
+}
+
+//unreachable partial syndromes, far above any real cost of a segment but far from 16 bit saturation as well
+static constexpr int16_t stcInfinity = 0x4000;
+
+#ifdef CODING_SIMD
+
+//state s is lane s % 8 of register s / 8, xor of the state with 'Lo' swaps lanes
+template<int Lo>
+static inline __m128i laneXor(__m128i x){
+    if constexpr ((Lo & 1) != 0)
+        x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xb1), 0xb1);
+    if constexpr ((Lo & 2) != 0)
+        x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0x4e), 0x4e);
+    if constexpr ((Lo & 4) != 0)
+        x = _mm_shuffle_epi32(x, 0x4e);
+    return x;
+}
+
+//one channel: every state keeps its cover bit (y = 0) or comes from state ^ column (y = 1), the cheaper one wins
+template<int Lo>
+static inline void stcStep(const __m128i* costs, __m128i* next, uint8_t* path, uint32_t hi, __m128i keep, __m128i change){
+    for (uint32_t v = 0; v < stcStates / 8; v += 2){
+        __m128i a0 = _mm_adds_epi16(costs[v], keep), b0 = _mm_adds_epi16(laneXor<Lo>(costs[v ^ hi]), change);
+        __m128i a1 = _mm_adds_epi16(costs[v + 1], keep), b1 = _mm_adds_epi16(laneXor<Lo>(costs[(v + 1) ^ hi]), change);
+
+        next[v] = _mm_min_epi16(a0, b0);
+        next[v + 1] = _mm_min_epi16(a1, b1);
+
+        int bits = _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpgt_epi16(a0, b0), _mm_cmpgt_epi16(a1, b1)));
+        path[v] = bits;
+        path[v + 1] = bits >> 8;
+    }
+}
+
+//drops the finished data bit: state t continues from state 2t + bit, states with the new top row set are unreachable
+static inline void stcShift(__m128i* costs, uint8_t bit){
+    __m128i minimum = _mm_set1_epi16(stcInfinity);
+
+    for (uint32_t u = 0; u < stcStates / 16; u++){
+        __m128i even = costs[2 * u], odd = costs[2 * u + 1];
+
+        if(bit)
+            costs[u] = _mm_packs_epi32(_mm_srai_epi32(even, 16), _mm_srai_epi32(odd, 16));
+        else
+            costs[u] = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(even, 16), 16), _mm_srai_epi32(_mm_slli_epi32(odd, 16), 16));
+
+        minimum = _mm_min_epi16(minimum, costs[u]);
+    }
+
+    //costs are kept relative to the best state so they never saturate
+    minimum = _mm_min_epi16(minimum, _mm_shuffle_epi32(minimum, 0x4e));
+    minimum = _mm_min_epi16(minimum, _mm_shuffle_epi32(minimum, 0xb1));
+    minimum = _mm_min_epi16(minimum, _mm_shufflelo_epi16(minimum, 0xb1));
+    minimum = _mm_shuffle_epi32(_mm_shufflelo_epi16(minimum, 0), 0);
+
+    for (uint32_t u = 0; u < stcStates / 16; u++)
+        costs[u] = _mm_sub_epi16(costs[u], minimum);
+
+    for (uint32_t u = stcStates / 16; u < stcStates / 8; u++)
+        costs[u] = _mm_set1_epi16(stcInfinity);
+}
+
+static uint32_t stcForward(const uint8_t* lsbs, const uint8_t* costs, const uint8_t* data, uint64_t bits, uint8_t width, const uint8_t* columns, uint8_t* path){
+    //costs before and after every channel, swapped instead of copied
+    __m128i buffers[2][stcStates / 8];
+    __m128i *trellis = buffers[0], *next = buffers[1];
+
+    for (uint32_t v = 0; v < stcStates / 8; v++)
+        trellis[v] = _mm_set1_epi16(stcInfinity);
+    trellis[0] = _mm_insert_epi16(trellis[0], 0, 0);
+
+    for (uint64_t bit = 0, channel = 0; bit < bits; bit++){
+        for (uint8_t j = 0; j < width; j++, channel++){
+            int16_t cost = costs ? costs[channel] : 1;
+            __m128i keep = _mm_set1_epi16(lsbs[channel] ? cost : 0);
+            __m128i change = _mm_set1_epi16(lsbs[channel] ? 0 : cost);
+
+            uint8_t* columnPath = path + channel * (stcStates / 8);
+            uint32_t hi = columns[j] >> 3;
+
+            switch (columns[j] & 7){
+                case 0: stcStep<0>(trellis, next, columnPath, hi, keep, change); break;
+                case 1: stcStep<1>(trellis, next, columnPath, hi, keep, change); break;
+                case 2: stcStep<2>(trellis, next, columnPath, hi, keep, change); break;
+                case 3: stcStep<3>(trellis, next, columnPath, hi, keep, change); break;
+                case 4: stcStep<4>(trellis, next, columnPath, hi, keep, change); break;
+                case 5: stcStep<5>(trellis, next, columnPath, hi, keep, change); break;
+                case 6: stcStep<6>(trellis, next, columnPath, hi, keep, change); break;
+                case 7: stcStep<7>(trellis, next, columnPath, hi, keep, change); break;
+            }
+
+            std::swap(trellis, next);
+        }
+
+        stcShift(trellis, dataBit(data, bit));
+    }
+
+    alignas(16) int16_t final[stcStates];
+    for (uint32_t v = 0; v < stcStates / 8; v++)
+        _mm_store_si128(reinterpret_cast<__m128i*>(final + v * 8), trellis[v]);
+
+    uint32_t best = 0;
+    for (uint32_t s = 1; s < stcStates; s++)
+        if(final[s] < final[best])
+            best = s;
+
+    return best;
+}
+
+#else
+
+static uint32_t stcForward(const uint8_t* lsbs, const uint8_t* costs, const uint8_t* data, uint64_t bits, uint8_t width, const uint8_t* columns, uint8_t* path){
+    int32_t trellis[stcStates], next[stcStates];
+    for (uint32_t s = 0; s < stcStates; s++)
+        trellis[s] = stcInfinity;
+    trellis[0] = 0;
+
+    for (uint64_t bit = 0, channel = 0; bit < bits; bit++){
+        for (uint8_t j = 0; j < width; j++, channel++){
+            int32_t cost = costs ? costs[channel] : 1;
+            int32_t keep = lsbs[channel] ? cost : 0, change = lsbs[channel] ? 0 : cost;
+
+            uint8_t* columnPath = path + channel * (stcStates / 8);
+            for (uint32_t s = 0; s < stcStates; s++){
+                int32_t a = trellis[s] + keep, b = trellis[s ^ columns[j]] + change;
+                next[s] = a > b ? b : a;
+
+                if(s % 8 == 0)
+                    columnPath[s / 8] = 0;
+                columnPath[s / 8] |= (a > b) << (s % 8);
+            }
+
+            for (uint32_t s = 0; s < stcStates; s++)
+                trellis[s] = next[s];
+        }
+
+        uint8_t value = dataBit(data, bit);
+        int32_t minimum = stcInfinity;
+
+        for (uint32_t s = 0; s < stcStates / 2; s++){
+            trellis[s] = trellis[2 * s + value];
+            minimum = trellis[s] < minimum ? trellis[s] : minimum;
+        }
+
+        for (uint32_t s = 0; s < stcStates / 2; s++)
+            trellis[s] -= minimum;
+
+        for (uint32_t s = stcStates / 2; s < stcStates; s++)
+            trellis[s] = stcInfinity;
+    }
+
+    uint32_t best = 0;
+    for (uint32_t s = 1; s < stcStates; s++)
+        if(trellis[s] < trellis[best])
+            best = s;
+
+    return best;
+}
+
+#endif
+
+void stcEmbed(uint8_t* lsbs, const uint8_t* costs, const uint8_t* data, uint64_t bytes, uint8_t width){
+    uint8_t columns[stcMaxWidth];
+    stcColumns(width, columns);
+
+    uint64_t bits = bytes * 8;
+    uint64_t channels = stcSlots(bytes, width);
+
+    //one bit per state per channel for the traceback, reused by the thread for every segment
+    thread_local std::vector<uint8_t> path;
+    path.resize(channels * (stcStates / 8));
+
+    uint32_t state = stcForward(lsbs, costs, data, bits, width, columns, path.data());
+
+    //walking back from the best final state gives the stego bit of every channel
+    for (uint64_t bit = bits, channel = channels; bit-- > 0;){
+        state = (state << 1 | dataBit(data, bit)) & (stcStates - 1);
+
+        for (uint8_t j = width; j-- > 0;){
+            channel--;
+            uint8_t y = (path[channel * (stcStates / 8) + state / 8] >> (state % 8)) & 1;
+
+            lsbs[channel] = y;
+            if(y)
+                state ^= columns[j];
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef CODING_HPP
+#define CODING_HPP
+
+#include <cstdint>
+
+/*
+    Syndrome coding of 1 LSB per channel: the data is the syndrome H * lsbs of the cover LSBs,
+    so the embedder only flips the few LSBs that give the right syndrome and extraction is a parity multiply.
+
+    Data is coded in independent segments of codingSegment bytes (the last one can be shorter),
+    which start at fixed channels so every thread and byte range works on its own segments.
+
+    Hamming: every 'k' data bits go in 2^k - 1 channels, at most 1 flip. The channel at (1 based)
+    index i adds i to the syndrome, a partial last block is padded with 0 bits.
+
+    STC (syndrome-trellis codes): every data bit goes in 'width' channels, H is a band of the same
+    stcHeight x width submatrix moved down one row per data bit. The embedder finds the flips
+    of least total cost with the Viterbi algorithm over 2^stcHeight partial syndromes,
+    so flips go to the cheapest channels when costs are given.
+*/
+
+inline constexpr uint64_t codingSegment = 512;
+
+inline constexpr uint8_t hammingMinBits = 2;
+inline constexpr uint8_t hammingMaxBits = 10;
+
+inline constexpr uint8_t stcHeight = 7;
+inline constexpr uint8_t stcMinWidth = 2;
+inline constexpr uint8_t stcMaxWidth = 10;
+inline constexpr uint8_t stcMaxCost = 127; //keeps trellis costs of one segment far from the 16 bit saturation
+
+//channels used by 'bytes' bytes of one segment
+uint64_t hammingSlots(uint64_t bytes, uint8_t k);
+uint64_t stcSlots(uint64_t bytes, uint8_t width);
+
+//'lsbs' holds the cover LSB (0 or 1) of every channel of the segment and is changed in place to carry 'data'
+void hammingEmbed(uint8_t* lsbs, const uint8_t* data, uint64_t bytes, uint8_t k);
+void hammingExtract(const uint8_t* lsbs, uint8_t* data, uint64_t bytes, uint8_t k);
+
+//'costs' is the cost of flipping every channel (1 to stcMaxCost), nullptr costs 1 everywhere
+void stcEmbed(uint8_t* lsbs, const uint8_t* costs, const uint8_t* data, uint64_t bytes, uint8_t width);
+void stcExtract(const uint8_t* lsbs, uint8_t* data, uint64_t bytes, uint8_t width);
+
+#endif
@@ -0,0 +1,174 @@
+#include "compress.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+static constexpr int hashBits = 14;
+static constexpr uint64_t minMatch = 4;
+static constexpr uint64_t maxOffset = UINT16_MAX;
+
+static uint32_t read32(const uint8_t* data){
+    uint32_t value;
+    std::memcpy(&value, data, 4);
+    return value;
+}
+
+static uint32_t hash(uint32_t sequence){
+    return (sequence * 2654435761u) >> (32 - hashBits);
+}
+
+//length of the common prefix of a and b, at most 'limit' bytes
+static uint64_t matchLength(const uint8_t* a, const uint8_t* b, uint64_t limit){
+    uint64_t length = 0;
+
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    //8 bytes at a time, first differing byte is found from the trailing zeros
+    for (; length + 8 <= limit; length += 8){
+        uint64_t x, y;
+        std::memcpy(&x, a + length, 8);
+        std::memcpy(&y, b + length, 8);
+
+        if(x != y)
+            return length + (__builtin_ctzll(x ^ y) >> 3);
+    }
+#endif
+
+    while (length < limit && a[length] == b[length])
+        length++;
+
+    return length;
+}
+
+//writes the part of a length that does not fit in the token
+static uint8_t* writeLength(uint8_t* dst, uint64_t length){
+    for (; length >= 255; length -= 255)
+        *dst++ = 255;
+
+    *dst++ = length;
+    return dst;
+}
+
+static bool readLength(const uint8_t* &src, const uint8_t* end, uint64_t &length){
+    uint8_t byte;
+
+    do{
+        if(src == end)
+            return false;
+
+        byte = *src++;
+        length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+//match length 0 writes the last sequence of the block (literals only)
+static uint8_t* writeSequence(uint8_t* dst, const uint8_t* literals, uint64_t literalLength, uint64_t offset, uint64_t length){
+    uint8_t *token = dst++;
+
+    *token = std::min<uint64_t>(literalLength, 15) << 4;
+    if(literalLength >= 15)
+        dst = writeLength(dst, literalLength - 15);
+
+    std::memcpy(dst, literals, literalLength);
+    dst += literalLength;
+
+    if(length == 0)
+        return dst;
+
+    *dst++ = offset & UINT8_MAX;
+    *dst++ = offset >> 8;
+
+    length -= minMatch;
+    *token |= std::min<uint64_t>(length, 15);
+    if(length >= 15)
+        dst = writeLength(dst, length - 15);
+
+    return dst;
+}
+
+uint64_t compressBound(uint64_t size){
+    return size + size / 255 + 16;
+}
+
+uint64_t compressBlock(const uint8_t* src, uint64_t size, uint8_t* dst){
+    std::vector<uint32_t> table(1 << hashBits, UINT32_MAX); //last position of every hashed 4 byte sequence
+
+    uint8_t *out = dst;
+    uint64_t anchor = 0, iterator = 0;
+
+    while (iterator + minMatch <= size){
+        uint32_t sequence = read32(src + iterator);
+        uint32_t &slot = table[hash(sequence)];
+        uint64_t reference = slot;
+        slot = iterator;
+
+        if(reference != UINT32_MAX && iterator - reference <= maxOffset && read32(src + reference) == sequence){
+            uint64_t length = minMatch + matchLength(src + reference + minMatch, src + iterator + minMatch, size - iterator - minMatch);
+
+            out = writeSequence(out, src + anchor, iterator - anchor, iterator - reference, length);
+            iterator += length;
+            anchor = iterator;
+
+            //positions inside the match are skipped, so the one just before its end is still hashed
+            if(iterator + 2 <= size)
+                table[hash(read32(src + iterator - 2))] = iterator - 2;
+        }
+        else{
+            iterator += 1 + ((iterator - anchor) >> 6); //steps grow through incompressible data
+        }
+    }
+
+    out = writeSequence(out, src + anchor, size - anchor, 0, 0);
+
+    return out - dst;
+}
+
+bool decompressBlock(const uint8_t* src, uint64_t size, uint8_t* dst, uint64_t originalSize){
+    const uint8_t *end = src + size;
+    uint64_t iterator = 0;
+
+    while (src < end){
+        uint8_t token = *src++;
+
+        uint64_t literalLength = token >> 4;
+        if(literalLength == 15 && !readLength(src, end, literalLength))
+            return false;
+
+        if(literalLength > uint64_t(end - src) || literalLength > originalSize - iterator)
+            return false;
+
+        std::memcpy(dst + iterator, src, literalLength);
+        src += literalLength;
+        iterator += literalLength;
+
+        if(src == end)
+            break;
+
+        if(end - src < 2)
+            return false;
+
+        uint64_t offset = src[0] | (src[1] << 8);
+        src += 2;
+
+        uint64_t length = token & 15;
+        if(length == 15 && !readLength(src, end, length))
+            return false;
+
+        length += minMatch;
+        if(offset == 0 || offset > iterator || length > originalSize - iterator)
+            return false;
+
+        //matches can overlap with the bytes they produce, so short offsets are copied byte by byte
+        if(offset >= length)
+            std::memcpy(dst + iterator, dst + iterator - offset, length);
+        else
+            for (uint64_t i = 0; i < length; i++)
+                dst[iterator + i] = dst[iterator + i - offset];
+
+        iterator += length;
+    }
+
+    return iterator == originalSize;
+}
@@ -0,0 +1,26 @@
+#ifndef COMPRESS_HPP
+#define COMPRESS_HPP
+
+#include <cstdint>
+
+/*
+    LZ4 style block compression:
+        every block is a list of sequences, each sequence is
+        - Token (1 byte): high 4 bits literal length, low 4 bits match length - 4 (15 means more length bytes follow)
+        - Literal length bytes (255 means another byte follows)
+        - Literals
+        - Match offset (2 bytes, little endian) and match length bytes, omitted in the last sequence
+
+    Blocks don't reference each other, so they can be compressed and decompressed in parallel.
+*/
+
+//maximum compressed size of a block of 'size' bytes
+uint64_t compressBound(uint64_t size);
+
+//compresses a block into dst (at least compressBound(size) bytes), returns the compressed size
+uint64_t compressBlock(const uint8_t* src, uint64_t size, uint8_t* dst);
+
+//decompresses a block of exactly 'originalSize' bytes, returns false if the block is corrupted
+bool decompressBlock(const uint8_t* src, uint64_t size, uint8_t* dst, uint64_t originalSize);
+
+#endif
@@ -0,0 +1,66 @@
+#include "crc32c.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #include <nmmintrin.h>
+    #define CRC32C_HW 1
+#endif
+
+//reflected polynomial of CRC-32C
+static constexpr uint32_t polynomial = 0x82F63B78;
+
+static constexpr std::array<uint32_t, 256> makeTable(){
+    std::array<uint32_t, 256> table{};
+
+    for (uint32_t i = 0; i < 256; i++){
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++)
+            crc = (crc >> 1) ^ (polynomial & (0 - (crc & 1)));
+        table[i] = crc;
+    }
+
+    return table;
+}
+
+static constexpr std::array<uint32_t, 256> table = makeTable();
+
+static uint32_t crc32cSoftware(const uint8_t* data, uint64_t size, uint32_t crc){
+    for (uint64_t i = 0; i < size; i++)
+        crc = (crc >> 8) ^ table[(crc ^ data[i]) & UINT8_MAX];
+
+    return crc;
+}
+
+#ifdef CRC32C_HW
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(const uint8_t* data, uint64_t size, uint32_t crc){
+    uint64_t crc64 = crc;
+
+    //8 bytes per instruction, tail is handled byte by byte
+    for (; size >= 8; size -= 8, data += 8){
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = (uint32_t)crc64;
+    for (; size > 0; size--, data++)
+        crc = _mm_crc32_u8(crc, *data);
+
+    return crc;
+}
+#endif
+
+uint32_t crc32c(const uint8_t* data, uint64_t size, uint32_t crc){
+    crc = ~crc;
+
+#ifdef CRC32C_HW
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware)
+        return ~crc32cHardware(data, size, crc);
+#endif
+
+    return ~crc32cSoftware(data, size, crc);
+}
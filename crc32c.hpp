@@ -0,0 +1,9 @@
+#ifndef CRC32C_HPP
+#define CRC32C_HPP
+
+#include <cstdint>
+
+//CRC-32C (Castagnoli), uses the SSE4.2 crc32 instruction when the cpu supports it
+uint32_t crc32c(const uint8_t* data, uint64_t size, uint32_t crc = 0);
+
+#endif
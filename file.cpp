@@ -1,7 +1,24 @@
 #include "file.hpp"
+#include "stats.hpp"
+#include "crc32c.hpp"
+#include "aes.hpp"
+#include "header.hpp"
+#include "kdf.hpp"
+
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <sys/random.h>
+#endif
 
 //File
 void File::save(){
+
+    Span span("write", original_size_);
     
     std::filesystem::create_directory("retrieved");
 
@@ -9,7 +26,7 @@ void File::save(){
     if(!fout)
         throw std::runtime_error("Failed to create file: " + filepath_.filename().string());
 
-    fout.write(reinterpret_cast<char*>(data_), original_size_);
+    fout.write(reinterpret_cast<char*>(data_.data()), original_size_);
     fout.close();
 }
 
@@ -28,26 +45,26 @@ File::File(const char *filepath) {
     if (original_size_ <= 0)
         throw std::runtime_error("Please enter a valid file.\nFile is empty: \"" + filepath_.string() + '\"');
 
+    Span span("read", original_size_);
+
     std::string extension = filepath_.extension().string() + '\0';
     size_ = original_size_ + extension.length();
     
-    data_ = new uint8_t[size_];
+    data_ = Memory::arena(size_);
 
-    fin.read(reinterpret_cast<char*>(data_), original_size_);
+    fin.read(reinterpret_cast<char*>(data_.data()), original_size_);
 
     fin.close();
 
     //put extension in data (in reverse)
     for (uint64_t i = size_ - 1; i >= original_size_; i--)
-        data_[i] = extension[size_ - 1 - i];
+        data_.data()[i] = extension[size_ - 1 - i];
 
 }
 
-File::File(const std::string filename, uint8_t* &data, const uint64_t size) : data_(data), size_(size){
-    data = nullptr;
+File::File(const std::string filename, Memory data) : data_(std::move(data)), size_(data_.size()){
 
     if (size_ <= 0){
-        delete[] data_;
         throw std::runtime_error("Can't create an empty file : " + filename);
     }
 
@@ -56,7 +73,7 @@ File::File(const std::string filename, uint8_t* &data, const uint64_t size) : da
     //get extension
     std::string extension;
     while (rev_iterator >= 0) {
-        char c = data_[rev_iterator--];
+        char c = data_.data()[rev_iterator--];
 
         if(c == '\0')
             break;
@@ -75,10 +92,6 @@ File::File(const std::string filename, uint8_t* &data, const uint64_t size) : da
     
 }
 
-File::~File(){
-    delete[] data_;
-}
-
 //getters
 
 uint64_t File::size(){
@@ -86,40 +99,247 @@ uint64_t File::size(){
 }
 
 uint8_t* File::data(){
-    return data_;
+    return data_.data();
+}
+
+ByteSpan File::bytes(){
+    return data_.bytes();
 }
 
 //Key
 
-void Key::generateKey(const char* filename, const uint8_t key_size) {
-    // Validate key size
-    if (key_size != 16 && key_size != 24 && key_size != 32)
-        throw std::runtime_error("Invalid key size. Must be 16, 24, or 32 bytes.");
+//memset that the compiler can't drop because the memory is about to be freed
+static void secureZero(void* data, size_t size){
+    volatile uint8_t *bytes = static_cast<volatile uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+        bytes[i] = 0;
+}
+
+static DataCipher makeDataCipher(uint8_t cipher, const uint8_t* key, uint8_t keySize){
+    if(cipher == Header::aesCtr){
+        switch (keySize){
+            case 16: return DataCipher(std::in_place_type<Aes<16>>, key);
+            case 24: return DataCipher(std::in_place_type<Aes<24>>, key);
+            case 32: return DataCipher(std::in_place_type<Aes<32>>, key);
+        }
+
+        throw std::runtime_error("Invalid key size " + std::to_string(keySize) + ". Must be 16, 24, or 32 bytes.");
+    }
+
+    if(cipher == Header::chacha20){
+        switch (keySize){
+            case 16: return DataCipher(std::in_place_type<ChaCha20<16>>, key);
+            case 32: return DataCipher(std::in_place_type<ChaCha20<32>>, key);
+        }
+
+        throw std::runtime_error("Invalid key size " + std::to_string(keySize) + " for ChaCha20. Must be 16 or 32 bytes.");
+    }
+
+    throw std::runtime_error("Unsupported cipher " + std::to_string(cipher) + '.');
+}
+
+//ciphers zeroize their own round keys
+struct KeySchedule{
+    std::vector<uint8_t> material; //cipher, iv and key, compared on lookup so fingerprint collisions are harmless
+    Aes<16> header;
+    DataCipher data;
+
+    KeySchedule(std::vector<uint8_t> &&material, uint8_t cipher, const uint8_t* key, uint8_t keySize, const uint8_t* iv)
+        : material(std::move(material)), header(iv), data(makeDataCipher(cipher, key, keySize)){
+    }
+
+    ~KeySchedule(){
+        secureZero(material.data(), material.size());
+    }
+};
+
+/*
+    Key schedules are expanded once per key and reused by later jobs with the same key file.
+    The cache keeps the most recently used keys, an evicted schedule is zeroized as soon as
+    no Key uses it anymore.
+*/
+static constexpr size_t keyCacheSize = 64;
+
+static std::mutex keyCacheMutex;
+static std::list<std::shared_ptr<const KeySchedule>> keyCacheOrder; //most recently used first
+static std::unordered_multimap<uint64_t, std::list<std::shared_ptr<const KeySchedule>>::iterator> keyCache;
 
+static uint64_t fingerprint(const std::vector<uint8_t> &material){
+    return (uint64_t)crc32c(material.data(), material.size()) << 32 | crc32c(material.data(), material.size(), 0x9E3779B9);
+}
+
+static std::shared_ptr<const KeySchedule> expandKey(uint8_t cipher, const uint8_t* key, uint8_t keySize, const uint8_t* iv, uint8_t ivSize){
+    std::vector<uint8_t> material(1, cipher);
+    material.insert(material.end(), iv, iv + ivSize);
+    material.insert(material.end(), key, key + keySize);
+    uint64_t id = fingerprint(material);
+
+    std::lock_guard<std::mutex> lock(keyCacheMutex);
+
+    auto range = keyCache.equal_range(id);
+    for (auto it = range.first; it != range.second; ++it){
+        if((*it->second)->material == material){
+            keyCacheOrder.splice(keyCacheOrder.begin(), keyCacheOrder, it->second);
+            secureZero(material.data(), material.size());
+            return *it->second;
+        }
+    }
+
+    auto schedule = std::make_shared<KeySchedule>(std::move(material), cipher, key, keySize, iv);
+
+    keyCacheOrder.push_front(schedule);
+    keyCache.emplace(id, keyCacheOrder.begin());
+
+    if(keyCacheOrder.size() > keyCacheSize){
+        uint64_t evicted = fingerprint(keyCacheOrder.back()->material);
+        auto range = keyCache.equal_range(evicted);
+
+        for (auto it = range.first; it != range.second; ++it){
+            if(it->second == std::prev(keyCacheOrder.end())){
+                keyCache.erase(it);
+                break;
+            }
+        }
+
+        keyCacheOrder.pop_back();
+    }
+
+    return schedule;
+}
+
+//fills data from the kernel CSPRNG
+void randomBytes(uint8_t* data, uint64_t size){
+#if defined(__linux__)
+    while (size > 0){
+        ssize_t count = getrandom(data, size, 0);
+        if(count < 0){
+            if(errno == EINTR)
+                continue;
+
+            throw std::runtime_error("Failed to read random bytes from the system.");
+        }
+
+        data += count;
+        size -= count;
+    }
+#else
+    std::ifstream fin("/dev/urandom", std::ios::binary);
+    if(!fin.read(reinterpret_cast<char*>(data), size))
+        throw std::runtime_error("Failed to read random bytes from the system.");
+#endif
+}
+
+static void writeKeyFile(const std::string &filename, const uint8_t* data, uint64_t size){
     std::filesystem::create_directory("keys");
 
-    std::filesystem::path filepath("keys/" + std::string(filename));
+    std::filesystem::path filepath("keys/" + filename);
     filepath.replace_extension(".key");
-    
-    std::ofstream fout(filepath , std::ios::binary);
+
+    std::ofstream fout(filepath, std::ios::binary);
     if(!fout)
         throw std::runtime_error("Failed to create file: " + filepath.stem().string());
-    
-    uint8_t data[key_size + 16];
 
-    // Fill with random data
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<uint8_t> dis(0, 255);
+    fout.write(reinterpret_cast<const char*>(data), size);
+    fout.close();
+}
+
+void Key::generateKey(const char* filename, const uint8_t key_size, uint64_t count) {
+    // Validate key size
+    if (key_size != 16 && key_size != 24 && key_size != 32)
+        throw std::runtime_error("Invalid key size. Must be 16, 24, or 32 bytes.");
+
+    if (count == 0)
+        throw std::runtime_error("Invalid key count. Must be at least 1.");
 
-    for (int i = 0; i < key_size + 16; ++i)
-        data[i] = dis(gen);
+    //one read for every key, each file is the IV followed by the key
+    uint64_t size = key_size + 16;
+    std::vector<uint8_t> data(count * size);
+    randomBytes(data.data(), data.size());
 
-    // Save to file
+    if (count == 1){
+        writeKeyFile(filename, data.data(), size);
+    }
+    else{
+        size_t digits = std::to_string(count).length();
 
-    fout.write(reinterpret_cast<char*>(data), key_size + 16);
+        for (uint64_t i = 0; i < count; i++){
+            std::string number = std::to_string(i + 1);
+            writeKeyFile(std::string(filename) + '_' + std::string(digits - number.length(), '0') + number, data.data() + i * size, size);
+        }
+    }
 
-    fout.close();
+    secureZero(data.data(), data.size());
+}
+
+/*
+    Passphrase keys: scrypt with a fixed salt, the IV has to be known before the header can be read
+    so there is nowhere to keep a per image salt. 48 bytes are derived (IV and a 32 byte key),
+    smaller key sizes use the start of the key, so retrieval works with the key size from the header.
+*/
+static const std::string passphraseSalt = "PixelHide passphrase key";
+
+static std::mutex passphraseCacheMutex;
+static std::unordered_map<std::string, std::vector<uint8_t>> passphraseCache; //by SHA-256 of the passphrase
+
+static std::vector<uint8_t> derivePassphrase(const std::string &passphrase){
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(passphrase.data());
+    std::array<uint8_t, 32> digest = sha256(bytes, passphrase.size());
+    std::string id(digest.begin(), digest.end());
+
+    std::lock_guard<std::mutex> lock(passphraseCacheMutex);
+
+    auto it = passphraseCache.find(id);
+    if(it != passphraseCache.end())
+        return it->second;
+
+    if(passphraseCache.size() >= keyCacheSize){
+        for (auto &entry : passphraseCache)
+            secureZero(entry.second.data(), entry.second.size());
+        passphraseCache.clear();
+    }
+
+    Span span("kdf");
+
+    std::vector<uint8_t> material(16 + 32);
+    scrypt(material.data(), material.size(), bytes, passphrase.size(), reinterpret_cast<const uint8_t*>(passphraseSalt.data()), passphraseSalt.size());
+
+    passphraseCache.emplace(id, material);
+    return material;
+}
+
+Key Key::fromPassphrase(const std::string &passphrase, const uint8_t key_size){
+    if (key_size != 16 && key_size != 24 && key_size != 32)
+        throw std::runtime_error("Invalid key size. Must be 16, 24, or 32 bytes.");
+
+    if (passphrase.empty())
+        throw std::runtime_error("The passphrase is empty.");
+
+    std::vector<uint8_t> material = derivePassphrase(passphrase);
+
+    Key key;
+    key.key_size_ = key_size;
+    key.iv_size_ = 16;
+
+    key.iv_ = std::make_unique<uint8_t[]>(key.iv_size_);
+    key.key_ = std::make_unique<uint8_t[]>(key.key_size_);
+
+    std::copy_n(material.data(), key.iv_size_, key.iv_.get());
+    std::copy_n(material.data() + key.iv_size_, key.key_size_, key.key_.get());
+
+    secureZero(material.data(), material.size());
+
+    key.schedule_ = expandKey(key.cipher_, key.key_.get(), key.key_size_, key.iv_.get(), key.iv_size_);
+
+    return key;
+}
+
+void Key::save(const char* filename){
+    std::vector<uint8_t> data(iv_.get(), iv_.get() + iv_size_);
+    data.insert(data.end(), key_.get(), key_.get() + key_size_);
+
+    writeKeyFile(filename, data.data(), data.size());
+
+    secureZero(data.data(), data.size());
 }
 
 Key::Key(const char *filepath, const uint8_t key_size) : key_size_(key_size), iv_size_(16) {
@@ -131,21 +351,27 @@ Key::Key(const char *filepath, const uint8_t key_size) : key_size_(key_size), iv
     if (!fin)
         throw std::runtime_error("Could not open key: \"" + filepath_.string() + '\"');
 
-    if (std::filesystem::file_size(filepath_) < iv_size_ + key_size_)
+    uint64_t fileSize = std::filesystem::file_size(filepath_);
+
+    //generated keys are the IV followed by 16, 24 or 32 bytes, other files use their first 16 bytes as before
+    if (key_size_ == 0)
+        key_size_ = fileSize == iv_size_ + 24u || fileSize == iv_size_ + 32u ? fileSize - iv_size_ : 16;
+
+    if (key_size_ != 16 && key_size_ != 24 && key_size_ != 32)
+        throw std::runtime_error("Invalid key size. Must be 16, 24, or 32 bytes.");
+
+    if (fileSize < iv_size_ + key_size_)
         throw std::runtime_error("Key size is less than " + std::to_string(iv_size_ + key_size_) + "\nPlease enter a valid key: \"" + filepath_.string() + '\"');
     
-    iv_ = new uint8_t[iv_size_];
-    key_ = new uint8_t[key_size_];
+    iv_ = std::make_unique<uint8_t[]>(iv_size_);
+    key_ = std::make_unique<uint8_t[]>(key_size_);
 
-    fin.read(reinterpret_cast<char*>(iv_), iv_size_);
-    fin.read(reinterpret_cast<char*>(key_), key_size_);
+    fin.read(reinterpret_cast<char*>(iv_.get()), iv_size_);
+    fin.read(reinterpret_cast<char*>(key_.get()), key_size_);
 
     fin.close();
-}
 
-Key::~Key(){
-    delete[] key_;
-    delete[] iv_;
+    schedule_ = expandKey(cipher_, key_.get(), key_size_, iv_.get(), iv_size_);
 }
 
 //getters
@@ -154,7 +380,7 @@ uint8_t Key::keySize(){
 }
 
 uint8_t* Key::key(){
-    return key_;
+    return key_.get();
 }
 
 uint8_t Key::IVSize(){
@@ -162,5 +388,33 @@ uint8_t Key::IVSize(){
 }
 
 uint8_t* Key::IV(){
-    return iv_;
+    return iv_.get();
+}
+
+ByteSpan Key::keyBytes(){
+    return {key_.get(), key_size_};
+}
+
+ByteSpan Key::IVBytes(){
+    return {iv_.get(), iv_size_};
+}
+
+const Aes<16>& Key::headerCipher(){
+    return schedule_->header;
+}
+
+uint8_t Key::cipher(){
+    return cipher_;
+}
+
+const DataCipher& Key::dataCipher(){
+    return schedule_->data;
+}
+
+void Key::useCipher(uint8_t cipher, uint8_t keySize){
+    if (keySize > key_size_)
+        throw std::runtime_error("The data was encrypted with a " + std::to_string(keySize) + " byte key, this key has " + std::to_string(key_size_) + " bytes.");
+
+    schedule_ = expandKey(cipher, key_.get(), keySize, iv_.get(), iv_size_);
+    cipher_ = cipher;
 }
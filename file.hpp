@@ -3,12 +3,24 @@
 
 #include<filesystem>
 #include <fstream>
-#include<random>
+#include <memory>
+
+#include "memory.hpp"
+#include "aes.hpp"
+#include "chacha.hpp"
+
+struct KeySchedule;
+
+//stream ciphers for the file data, selected with Header::cipher and the key size
+using DataCipher = std::variant<Aes<16>, Aes<24>, Aes<32>, ChaCha20<16>, ChaCha20<32>>;
+
+//fills data from the kernel CSPRNG
+void randomBytes(uint8_t* data, uint64_t size);
 
 class File{
 
 	private:
-		uint8_t *data_ = nullptr;
+		Memory data_; //file data followed by the extension in reverse
 
 		uint64_t original_size_ = 0;
 		uint64_t size_ = 0;
@@ -21,12 +33,18 @@ class File{
 
 	//constructors and destructor
 		File(const char *filepath);
-		File(const std::string filename, uint8_t* &data, const uint64_t size);
-		~File();
+		File(const std::string filename, Memory data); //retrieved data, laid out like data_
+
+		//move only
+		File(File&&) = default;
+		File& operator=(File&&) = default;
+		File(const File&) = delete;
+		File& operator=(const File&) = delete;
 
 	//getters
 		uint64_t size();
 		uint8_t* data();
+		ByteSpan bytes();
 };
 
 class Key {
@@ -34,25 +52,56 @@ class Key {
 	private:
 		std::filesystem::path filepath_;
 
-		uint8_t* key_ = nullptr;
-		uint8_t* iv_ = nullptr;
+		std::unique_ptr<uint8_t[]> key_;
+		std::unique_ptr<uint8_t[]> iv_;
 
 		uint8_t key_size_ = 0;
 		uint8_t iv_size_ = 0;
+		uint8_t cipher_ = 0; //Header::aesCtr or Header::chacha20
+
+		//expanded round keys, shared through a cache with every Key of the same bytes
+		std::shared_ptr<const KeySchedule> schedule_;
 
 	public:
 
-		static void generateKey(const char* filename, const uint8_t key_size = 16);
+		//random keys from the kernel CSPRNG, 'count' > 1 writes <filename>_1 to <filename>_<count> zero padded to the digits of count (batch_0001 to batch_1000)
+		static void generateKey(const char* filename, const uint8_t key_size = 16, uint64_t count = 1);
+
+		//IV and a 32 byte key derived with scrypt, cached per passphrase for the rest of the process
+		static Key fromPassphrase(const std::string &passphrase, const uint8_t key_size = 32);
+
+		//writes the IV and key to keys/<filename>.key
+		void save(const char* filename);
 
 		//constructors and destructor
-		Key(const char *filepath, const uint8_t key_size = 16);
-		~Key();
+		Key(const char *filepath, const uint8_t key_size = 0); //0: key size from the file size
+
+	private:
+		Key() = default;
+
+	public:
+
+		//move only
+		Key(Key&&) = default;
+		Key& operator=(Key&&) = default;
+		Key(const Key&) = delete;
+		Key& operator=(const Key&) = delete;
 
 		//getters
 		uint8_t keySize();
 		uint8_t* key();
 		uint8_t IVSize();
 		uint8_t* IV();
+		ByteSpan keyBytes();
+		ByteSpan IVBytes();
+		uint8_t cipher();
+
+		//expanded ciphers
+		const Aes<16>& headerCipher(); //IV as the key, block 0 of the header in ECB and the rest in CTR
+		const DataCipher& dataCipher(); //key with IV as the counter, file data in CTR
+
+		//data cipher 'cipher' with the first 'keySize' bytes of the key, for images written with another cipher or a smaller key size
+		void useCipher(uint8_t cipher, uint8_t keySize);
 
 };
 
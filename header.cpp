@@ -0,0 +1,396 @@
+#include "header.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "crc32c.hpp"
+#include "chacha.hpp"
+#include "coding.hpp"
+
+//little endian helpers
+template<typename T>
+static void put(std::vector<uint8_t> &out, T value){
+    for (size_t i = 0; i < sizeof(T); i++)
+        out.push_back((value >> (i * 8)) & UINT8_MAX);
+}
+
+template<typename T>
+static T get(const uint8_t* data, uint32_t &iterator){
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); i++)
+        value |= T(data[iterator++]) << (i * 8);
+    return value;
+}
+
+uint64_t Header::chunkCount() const{
+    return chunkSize == 0 ? 0 : (dataSize + chunkSize - 1) / chunkSize;
+}
+
+uint64_t Header::blockCount() const{
+    return compressBlockSize == 0 ? 0 : (originalSize + compressBlockSize - 1) / compressBlockSize;
+}
+
+uint32_t Header::size() const{
+    uint64_t size = fixedSize + chunkCount() * sizeof(uint32_t);
+
+    if(flags & compressedFlag)
+        size += 12 + blockCount() * sizeof(uint32_t);
+
+    if(flags & cipherFlag)
+        size += 2;
+
+    if(flags & authFlag)
+        size += 1 + (chunkCount() + 1) * tagSize;
+
+    if(flags & layoutFlag)
+        size += 5;
+
+    if(flags & codingFlag)
+        size += 2;
+
+    if(flags & adaptiveFlag)
+        size += 1;
+
+    if(flags & slotsFlag)
+        size += 2 + slots.size() * slotEntrySize;
+
+    if(flags & roiFlag)
+        size += 16;
+
+    if(flags & entryFlag)
+        size += 8;
+
+    if(flags & generationFlag)
+        size += 4 + chunkCount() * sizeof(uint32_t);
+
+    return size;
+}
+
+uint64_t Header::fileSize() const{
+    return (flags & compressedFlag) ? originalSize : dataSize;
+}
+
+uint32_t Header::crc() const{
+    std::vector<uint8_t> data = serialize();
+
+    uint32_t crc = 0;
+    for (int i = 0; i < 4; i++)
+        crc |= uint32_t(data[12 + i]) << (i * 8);
+
+    return crc;
+}
+
+std::vector<uint8_t> Header::serialize() const{
+    std::vector<uint8_t> out;
+    out.reserve(size());
+
+    for (int i = 0; i < 8; i++)
+        out.push_back(headerMarkerV2[i]);
+    put<uint32_t>(out, size());
+    put<uint32_t>(out, 0); //crc placeholder
+
+    put<uint8_t>(out, version);
+    put<uint8_t>(out, mode);
+    put<uint16_t>(out, flags);
+    put<uint64_t>(out, dataSize);
+    put<uint32_t>(out, chunkSize);
+
+    for (uint32_t crc : chunkCrc)
+        put<uint32_t>(out, crc);
+
+    if(flags & compressedFlag){
+        put<uint32_t>(out, compressBlockSize);
+        put<uint64_t>(out, originalSize);
+
+        for (uint32_t blockSize : compressedSizes)
+            put<uint32_t>(out, blockSize);
+    }
+
+    if(flags & cipherFlag){
+        put<uint8_t>(out, cipher);
+        put<uint8_t>(out, keySize);
+    }
+
+    if(flags & authFlag){
+        put<uint8_t>(out, mac);
+
+        for (const std::array<uint8_t, tagSize> &tag : chunkTags)
+            out.insert(out.end(), tag.begin(), tag.end());
+        out.insert(out.end(), headerTag.begin(), headerTag.end());
+    }
+
+    if(flags & layoutFlag){
+        put<uint8_t>(out, layout);
+        put<uint32_t>(out, tileSize);
+    }
+
+    if(flags & codingFlag){
+        put<uint8_t>(out, coding);
+        put<uint8_t>(out, codingParam);
+    }
+
+    if(flags & adaptiveFlag)
+        put<uint8_t>(out, threshold);
+
+    if(flags & slotsFlag){
+        put<uint16_t>(out, slots.size());
+
+        for (const Slot &slot : slots){
+            out.insert(out.end(), slot.keyId.begin(), slot.keyId.end());
+            put<uint32_t>(out, slot.firstRow);
+            put<uint32_t>(out, slot.rows);
+            put<uint64_t>(out, slot.dataSize);
+        }
+    }
+
+    if(flags & roiFlag){
+        put<uint32_t>(out, roiX);
+        put<uint32_t>(out, roiY);
+        put<uint32_t>(out, roiWidth);
+        put<uint32_t>(out, roiHeight);
+    }
+
+    if(flags & entryFlag){
+        put<uint32_t>(out, entry);
+        put<uint32_t>(out, previous);
+    }
+
+    if(flags & generationFlag){
+        put<uint32_t>(out, updates);
+
+        for (uint32_t generation : generations)
+            put<uint32_t>(out, generation);
+    }
+
+    uint32_t crc = crc32c(out.data(), out.size());
+    for (int i = 0; i < 4; i++)
+        out[12 + i] = (crc >> (i * 8)) & UINT8_MAX;
+
+    return out;
+}
+
+std::vector<uint8_t> Header::authenticated() const{
+    Header copy = *this;
+    copy.headerTag.fill(0);
+
+    std::vector<uint8_t> out = copy.serialize();
+    std::fill_n(out.begin() + 12, 4, 0);
+
+    return out;
+}
+
+uint32_t Header::parseBlock(const uint8_t* block){
+    if (std::memcmp(block, headerMarkerV2, 8) != 0)
+        return 0;
+
+    uint32_t iterator = 8;
+    uint32_t size = get<uint32_t>(block, iterator);
+
+    return size < fixedSize ? 0 : size;
+}
+
+Header Header::parse(const uint8_t* data, uint32_t size){
+    if (size < fixedSize || parseBlock(data) != size)
+        throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+    uint32_t iterator = 12;
+    uint32_t storedCrc = get<uint32_t>(data, iterator);
+
+    std::vector<uint8_t> copy(data, data + size);
+    std::memset(copy.data() + 12, 0, 4);
+    if (crc32c(copy.data(), size) != storedCrc)
+        throw std::runtime_error("Corrupted header. Header checksum does not match.");
+
+    Header header;
+    header.version = get<uint8_t>(data, iterator);
+    header.mode = get<uint8_t>(data, iterator);
+    header.flags = get<uint16_t>(data, iterator);
+    header.dataSize = get<uint64_t>(data, iterator);
+    header.chunkSize = get<uint32_t>(data, iterator);
+
+    if (header.version != currentVersion)
+        throw std::runtime_error("Unsupported header version " + std::to_string(header.version) + '.');
+
+    if (header.flags & ~(compressedFlag | cipherFlag | authFlag | layoutFlag | codingFlag | adaptiveFlag | slotsFlag | roiFlag | entryFlag | generationFlag | matchingFlag))
+        throw std::runtime_error("Unsupported header flags. Cannot retrieve the file.");
+
+    //slot directories hold no data of their own
+    bool directory = header.flags & slotsFlag;
+    if (directory && (header.flags != slotsFlag || header.mode != 1 || header.dataSize != 0 || header.chunkSize != 0))
+        throw std::runtime_error("Corrupted header. Invalid slot directory.");
+
+    if (!directory && (header.mode < 1 || header.mode > maxMode || header.dataSize < 1 || header.chunkSize == 0 || (header.mode == 3 && header.chunkSize % 3 != 0) || header.chunkCount() > (size - fixedSize) / sizeof(uint32_t)))
+        throw std::runtime_error("Corrupted header. The message length in the header is invalid. Cannot retrieve the file.");
+
+    header.chunkCrc.resize(header.chunkCount());
+    for (uint32_t &crc : header.chunkCrc)
+        crc = get<uint32_t>(data, iterator);
+
+    if (header.flags & compressedFlag){
+        if (iterator + 12 > size)
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        header.compressBlockSize = get<uint32_t>(data, iterator);
+        header.originalSize = get<uint64_t>(data, iterator);
+
+        if (header.compressBlockSize == 0 || header.originalSize < 1 || header.blockCount() > (size - iterator) / sizeof(uint32_t))
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        //compressed blocks must add up to the stored data
+        uint64_t storedSize = 0;
+
+        header.compressedSizes.resize(header.blockCount());
+        for (uint32_t &blockSize : header.compressedSizes){
+            blockSize = get<uint32_t>(data, iterator);
+            storedSize += blockSize & ~rawBlock;
+        }
+
+        if (storedSize != header.dataSize)
+            throw std::runtime_error("Corrupted header. Compressed block sizes don't match the data size.");
+    }
+
+    if (header.flags & cipherFlag){
+        if (iterator + 2 > size)
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        header.cipher = get<uint8_t>(data, iterator);
+        header.keySize = get<uint8_t>(data, iterator);
+
+        if (header.cipher != aesCtr && header.cipher != chacha20)
+            throw std::runtime_error("Unsupported cipher " + std::to_string(header.cipher) + " in the header.");
+
+        if (header.keySize != 16 && header.keySize != 32 && (header.keySize != 24 || header.cipher == chacha20))
+            throw std::runtime_error("Corrupted header. Invalid key size " + std::to_string(header.keySize) + '.');
+
+        //chunks are decrypted independently, each one has to start at a keystream block
+        if (header.cipher == chacha20 && header.chunkSize % chachaBlockSize != 0)
+            throw std::runtime_error("Corrupted header. Invalid chunk size for ChaCha20.");
+    }
+
+    if (header.flags & authFlag){
+        if (!(header.flags & cipherFlag) || iterator + 1 + (header.chunkCount() + 1) * tagSize > size)
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        header.mac = get<uint8_t>(data, iterator);
+        if (header.mac != poly1305)
+            throw std::runtime_error("Unsupported MAC " + std::to_string(header.mac) + " in the header.");
+
+        header.chunkTags.resize(header.chunkCount());
+        for (std::array<uint8_t, tagSize> &tag : header.chunkTags){
+            std::copy_n(data + iterator, tagSize, tag.begin());
+            iterator += tagSize;
+        }
+
+        std::copy_n(data + iterator, tagSize, header.headerTag.begin());
+        iterator += tagSize;
+    }
+
+    if (header.flags & layoutFlag){
+        if (!(header.flags & cipherFlag) || iterator + 5 > size)
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        header.layout = get<uint8_t>(data, iterator);
+        header.tileSize = get<uint32_t>(data, iterator);
+
+        if (header.layout != scatter && header.layout != tiled)
+            throw std::runtime_error("Unsupported layout " + std::to_string(header.layout) + " in the header.");
+
+        if (header.layout == tiled && header.tileSize == 0)
+            throw std::runtime_error("Corrupted header. Invalid tile size.");
+    }
+
+    if (header.flags & codingFlag){
+        if (iterator + 2 > size)
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        header.coding = get<uint8_t>(data, iterator);
+        header.codingParam = get<uint8_t>(data, iterator);
+
+        bool valid = (header.coding == hamming && header.codingParam >= hammingMinBits && header.codingParam <= hammingMaxBits) ||
+                     (header.coding == stc && header.codingParam >= stcMinWidth && header.codingParam <= stcMaxWidth);
+
+        if (!valid || header.mode != 1 || header.chunkSize % codingSegment != 0)
+            throw std::runtime_error("Unsupported coding " + std::to_string(header.coding) + " in the header.");
+    }
+
+    if (header.flags & adaptiveFlag){
+        if (iterator + 1 > size)
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        header.threshold = get<uint8_t>(data, iterator);
+
+        //selected channels are in image order and costs depend on replaced bits only
+        if ((header.flags & layoutFlag) || (header.flags & codingFlag && header.coding != stc))
+            throw std::runtime_error("Corrupted header. Adaptive embedding cannot be combined with this layout or coding.");
+    }
+
+    if (header.flags & slotsFlag){
+        if (iterator + 2 > size)
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        header.slots.resize(get<uint16_t>(data, iterator));
+        if (header.slots.empty() || header.slots.size() > (size - iterator) / slotEntrySize)
+            throw std::runtime_error("Corrupted header. Invalid slot directory.");
+
+        for (Slot &slot : header.slots){
+            std::copy_n(data + iterator, slotIdSize, slot.keyId.begin());
+            iterator += slotIdSize;
+
+            slot.firstRow = get<uint32_t>(data, iterator);
+            slot.rows = get<uint32_t>(data, iterator);
+            slot.dataSize = get<uint64_t>(data, iterator);
+
+            if (slot.rows == 0)
+                throw std::runtime_error("Corrupted header. Invalid slot directory.");
+        }
+    }
+
+    if (header.flags & roiFlag){
+        if (iterator + 16 > size)
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        header.roiX = get<uint32_t>(data, iterator);
+        header.roiY = get<uint32_t>(data, iterator);
+        header.roiWidth = get<uint32_t>(data, iterator);
+        header.roiHeight = get<uint32_t>(data, iterator);
+
+        //the rectangle is walked row by row in image order
+        if (header.roiWidth == 0 || header.roiHeight == 0 || (header.flags & (layoutFlag | adaptiveFlag)))
+            throw std::runtime_error("Corrupted header. Invalid region of interest.");
+    }
+
+    if (header.flags & entryFlag){
+        if (iterator + 8 > size)
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        header.entry = get<uint32_t>(data, iterator);
+        header.previous = get<uint32_t>(data, iterator);
+        if (header.entry == 0)
+            throw std::runtime_error("Corrupted header. Invalid entry index.");
+    }
+
+    if (header.flags & generationFlag){
+        if (!(header.flags & cipherFlag) || iterator + 4 > size || header.chunkCount() > (size - iterator - 4) / sizeof(uint32_t))
+            throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+        header.updates = get<uint32_t>(data, iterator);
+
+        header.generations.resize(header.chunkCount());
+        for (uint32_t &generation : header.generations){
+            generation = get<uint32_t>(data, iterator);
+
+            if (generation > header.updates)
+                throw std::runtime_error("Corrupted header. Invalid chunk generation.");
+        }
+
+        if (header.updates > maxGeneration)
+            throw std::runtime_error("Corrupted header. Invalid chunk generation.");
+    }
+
+    if (header.size() != size)
+        throw std::runtime_error("Corrupted header. Cannot retrieve the file.");
+
+    return header;
+}
@@ -0,0 +1,207 @@
+#ifndef HEADER_HPP
+#define HEADER_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/*
+    Header v2 Structure:
+        Stored at 1 LSB per channel right after the legacy mode bit, which is always 0 so
+        v1 readers look for their marker at 1 LSB, don't find it and report that no data was found.
+
+        - Block 0 (16 bytes / 128 bits), same place and size as the v1 marker + size:
+            - "PXHIDEV2" Marker (8 bytes)
+            - Header Size (4 bytes): total header size in bytes, block 0 included
+            - Header CRC32C (4 bytes): checksum of the whole header with this field set to 0
+        - Version (1 byte)
+        - Mode (1 byte): LSBs per pixel channel used for the data, 1 to 4 (v1 images only have 1 or 2),
+          at 3 LSBs every 3 bytes fill 8 channels and the chunk size is a multiple of 3
+        - Flags (2 bytes): optional sections present after the CRC table
+        - Data Size (8 bytes): size of the data in bytes, as stored in the image
+        - Chunk Size (4 bytes): data is split in chunks of this size for integrity checking
+        - Chunk CRC32C table (4 bytes per chunk): checksum of every chunk as stored in the image
+
+    Optional sections, in order of their flags:
+        - Compressed (flag 1 << 0): file data is compressed in independent blocks (see compress.hpp)
+            - Block Size (4 bytes): size of every block before compression (last one can be smaller)
+            - Original Size (8 bytes): size of the file data before compression
+            - Block size table (4 bytes per block): compressed size of every block,
+              highest bit set means the block is stored uncompressed
+        - Cipher (flag 1 << 1): written when the data is encrypted
+            - Cipher (1 byte): 0 -> AES in CTR mode, 1 -> ChaCha20 (chunk size is then a multiple of 64)
+            - Key Size (1 byte): 16, 24 or 32 bytes for AES-128/192/256, 16 or 32 for ChaCha20,
+              images without this section use AES with 16
+        - Authentication (flag 1 << 2): written with the cipher section when the data is authenticated
+            - MAC (1 byte): 0 -> Poly1305
+            - Chunk tag table (16 bytes per chunk): tag of every chunk as stored in the image (encrypted),
+              chunk index and data size are its associated data
+            - Header tag (16 bytes): tag of the whole header with this field and the header CRC set to 0
+        - Layout (flag 1 << 3): written with the cipher section when the data channels are not in order
+            - Layout (1 byte): 1 -> scatter, 2 -> tiled scatter (see scatter.hpp)
+            - Tile Size (4 bytes): usable channels per tile for tiled scatter
+        - Coding (flag 1 << 4): data is syndrome coded at 1 LSB (see coding.hpp), mode is then 1
+            - Coding (1 byte): 1 -> Hamming, 2 -> STC
+            - Parameter (1 byte): data bits per block for Hamming, channels per data bit for STC
+        - Adaptive (flag 1 << 5): data only goes to low cost channels (see adaptive.hpp), in image order
+            - Threshold (1 byte): highest cost of a data channel
+        - Slots (flag 1 << 6): the header is a plain directory of independent payloads, it has no other flags,
+          mode 1, a data size and chunk size of 0 and takes whole rows at the top of the image
+            - Slot Count (2 bytes)
+            - Slot table (24 bytes per slot):
+                - Key ID (8 bytes): header cipher of "PXSLOTID" followed by 8 zero bytes, all 0 for a payload without a key
+                - First Row (4 bytes) and Row Count (4 bytes): rows of the slot, a full embedding of its own
+                  (legacy mode bit, header and data) as if they were the whole image
+                - Data Size (8 bytes): data size in the header of the slot
+        - Region of interest (flag 1 << 7): data channels are only the ones inside a pixel rectangle, row by row,
+          which has to start after the header
+            - X, Y, Width, Height (4 bytes each): the rectangle in pixels
+        - Entry (flag 1 << 8): written in the headers of data appended to an image, every appended entry has its own
+          header at 1 LSB right after the data of the entry before it (see appendData in stego.hpp)
+            - Index (4 bytes): 1 for the first appended entry, 2 for the next one...
+            - Previous CRC (4 bytes): header CRC of the entry before it, so entries left over from an
+              earlier chain are not read after a new insert
+        - Generations (flag 1 << 9): written with the cipher section, chunks rewritten by an update get a fresh keystream
+            - Updates (4 bytes): number of updates of the entry, below 2^24
+            - Generation table (4 bytes per chunk): number of updates that changed the chunk, below 2^24
+        - Matching (flag 1 << 10): no fields, the data channels were changed by LSB matching and updates change them
+          the same way (never with adaptive embedding, whose costs read the bits +-1 can carry into)
+
+    Hidden data starts at the first channel after the header and is encoded with the header mode.
+    All multi-byte fields are little endian.
+
+    Encryption:
+        block 0 is encrypted using AES in ECB mode with Counter(Initialization Vector) as key, same as v1,
+        and the rest of the header using AES in CTR mode with the same key and the encrypted block 0 as counter.
+        The header is always encrypted with AES-128 so it can be read before the cipher and key size are known.
+
+    Appended entries use the IV with their index xored in as the counter of their data, scatter, matching and MAC
+    keystreams: into bytes 0-3, the top of the 128 bit AES counter, or bytes 12-15, the ChaCha20 nonce. Block counters
+    only add less than 2^60 to the low bytes, so entries written with the same key never share a keystream.
+
+    An update never reuses a keystream or a one-time MAC key: chunks use the entry IV with their generation xored in
+    (bytes 4-6 for AES, below the entry index, bytes 9-11 of the ChaCha20 nonce) for their data keystream and tag,
+    the header tag does the same with the update count. Scatter layouts and matching noise keep the entry IV.
+
+    Scatter layouts are seeded with 32 bytes of keystream block 0 of the data cipher with bit 6 of IV byte 8 flipped.
+
+    Authentication:
+        every tag has its own one-time Poly1305 key, the first 32 bytes of keystream block i (64 bytes per block)
+        of the data cipher with bit 7 of IV byte 8 flipped: i is the chunk index for chunk tags
+        and the chunk count for the header tag. Tags are computed and verified per chunk, so by every thread.
+*/
+
+inline const char headerMarkerV2[] = "PXHIDEV2";
+
+struct Header{
+
+	static constexpr uint8_t currentVersion = 2;
+	static constexpr uint32_t blockSize = 16;
+	static constexpr uint32_t fixedSize = blockSize + 16;
+	static constexpr uint8_t maxMode = 4;
+
+	static constexpr uint16_t compressedFlag = 1 << 0;
+	static constexpr uint16_t cipherFlag = 1 << 1;
+	static constexpr uint16_t authFlag = 1 << 2;
+	static constexpr uint16_t layoutFlag = 1 << 3;
+	static constexpr uint16_t codingFlag = 1 << 4;
+	static constexpr uint16_t adaptiveFlag = 1 << 5;
+	static constexpr uint16_t slotsFlag = 1 << 6;
+	static constexpr uint16_t roiFlag = 1 << 7;
+	static constexpr uint16_t entryFlag = 1 << 8;
+	static constexpr uint16_t generationFlag = 1 << 9;
+	static constexpr uint16_t matchingFlag = 1 << 10;
+	static constexpr uint8_t aesCtr = 0;
+	static constexpr uint8_t chacha20 = 1;
+	static constexpr uint8_t poly1305 = 0;
+	static constexpr uint32_t tagSize = 16;
+	static constexpr uint8_t linear = 0;
+	static constexpr uint8_t scatter = 1;
+	static constexpr uint8_t tiled = 2;
+	static constexpr uint8_t uncoded = 0;
+	static constexpr uint8_t hamming = 1;
+	static constexpr uint8_t stc = 2;
+	static constexpr uint32_t rawBlock = 1u << 31;
+	static constexpr uint32_t slotIdSize = 8;
+	static constexpr uint32_t slotEntrySize = slotIdSize + 16;
+	static constexpr uint32_t maxGeneration = (1 << 24) - 1;
+
+	uint8_t version = currentVersion;
+	uint8_t mode = 1;
+	uint16_t flags = 0;
+	uint64_t dataSize = 0;
+	uint32_t chunkSize = 0;
+	std::vector<uint32_t> chunkCrc;
+
+	//compression section
+	uint32_t compressBlockSize = 0;
+	uint64_t originalSize = 0;
+	std::vector<uint32_t> compressedSizes;
+
+	//cipher section
+	uint8_t cipher = aesCtr;
+	uint8_t keySize = 16;
+
+	//authentication section
+	uint8_t mac = poly1305;
+	std::vector<std::array<uint8_t, tagSize>> chunkTags;
+	std::array<uint8_t, tagSize> headerTag{};
+
+	//layout section
+	uint8_t layout = linear;
+	uint32_t tileSize = 0;
+
+	//coding section
+	uint8_t coding = uncoded;
+	uint8_t codingParam = 0;
+
+	//adaptive section
+	uint8_t threshold = 255;
+
+	//slot directory section
+	struct Slot{
+		std::array<uint8_t, slotIdSize> keyId{};
+		uint32_t firstRow = 0;
+		uint32_t rows = 0;
+		uint64_t dataSize = 0;
+	};
+	std::vector<Slot> slots;
+
+	//region of interest section
+	uint32_t roiX = 0;
+	uint32_t roiY = 0;
+	uint32_t roiWidth = 0;
+	uint32_t roiHeight = 0;
+
+	//entry section
+	uint32_t entry = 0;
+	uint32_t previous = 0;
+
+	//generation section
+	uint32_t updates = 0;
+	std::vector<uint32_t> generations;
+
+	uint64_t chunkCount() const;
+	uint64_t blockCount() const;
+	uint32_t size() const;
+
+	//size of the file data before compression
+	uint64_t fileSize() const;
+
+	//CRC stored in block 0 of the serialized header
+	uint32_t crc() const;
+
+	//serializes the header with its CRC filled in
+	std::vector<uint8_t> serialize() const;
+
+	//serialized header with the CRC and the header tag set to 0, covered by the header tag
+	std::vector<uint8_t> authenticated() const;
+
+	//checks if block 0 has the v2 marker, returns the header size or 0
+	static uint32_t parseBlock(const uint8_t* block);
+
+	//parses a full header, throws if it is corrupted
+	static Header parse(const uint8_t* data, uint32_t size);
+};
+
+#endif
@@ -1,23 +1,36 @@
+#include "arena.hpp"
+
+//pixels and PNG encoding buffers come from the job arena
+#define STBI_MALLOC(size) Arena::allocate(size)
+#define STBI_REALLOC(pointer, size) Arena::reallocate(pointer, size)
+#define STBI_FREE(pointer) Arena::release(pointer)
+#define STBIW_MALLOC(size) Arena::allocate(size)
+#define STBIW_REALLOC(pointer, size) Arena::reallocate(pointer, size)
+#define STBIW_FREE(pointer) Arena::release(pointer)
+
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb/stb_image.h"
 #include "stb/stb_image_write.h"
 
 #include "image.hpp"
+#include "stats.hpp"
 
 void Image::save(const bool bmp){
 
+    Span span("encode", size());
+
     std::filesystem::create_directory("output"); //creates folder if not exists
 
     std::string filename = "output/" + filepath_.stem().string() + "_i";
     bool success = false;
     if(bmp){
         filename += ".bmp";
-        success = stbi_write_bmp(filename.c_str(), width_, height_, channels_, data_);
+        success = stbi_write_bmp(filename.c_str(), width_, height_, channels_, data_.data());
     }
     else{
         filename += ".png";
-        success = stbi_write_png(filename.c_str(), width_, height_, channels_, data_, width_*channels_);
+        success = stbi_write_png(filename.c_str(), width_, height_, channels_, data_.data(), width_*channels_);
     }
 
     if(!success)
@@ -39,13 +52,34 @@ Image::Image(const char* filepath){
     if(!std::filesystem::exists(filepath_))
         throw std::runtime_error("File does not exist: \"" + filepath_.string() + '\"');
 
-    data_ = stbi_load(filepath, &width_, &height_, &channels_, 0);
-    if(data_ == nullptr)
+    Span span("decode");
+
+    uint8_t *pixels = stbi_load(filepath, &width_, &height_, &channels_, 0);
+    data_ = Memory::stb(pixels, size());
+    if(!data_)
         throw std::runtime_error("Could not load the image.\nPlease check if it's a valid image format: \"" + filepath_.string() + '\"');
+
+    span.bytes(size());
+}
+
+//blank image, allocated the same way as stb so it is freed the same way
+Image::Image(int width, int height, int channels, const std::string filename) : channels_(channels), width_(width), height_(height){
+    filepath_ = filename;
+
+    if(width_ <= 0 || height_ <= 0 || channels_ < 1 || channels_ > 4)
+        throw std::runtime_error("Invalid image dimensions: " + std::to_string(width_) + 'x' + std::to_string(height_) + 'x' + std::to_string(channels_));
+
+    data_ = Memory::stb((uint8_t*)STBI_MALLOC(size()), size());
+    if(!data_)
+        throw std::runtime_error("Could not allocate the image: " + filename);
 }
 
-Image::~Image(){
-    stbi_image_free(data_);
+//the view does not own its pixels, saving it writes the rows only
+Image::Image(Image &image, int firstRow, int rows) : filepath_(image.filepath_), channels_(image.channels_), width_(image.width_), height_(rows){
+    if(firstRow < 0 || rows <= 0 || firstRow + (uint64_t)rows > (uint64_t)image.height_)
+        throw std::runtime_error("Invalid rows " + std::to_string(firstRow) + '+' + std::to_string(rows) + " of a " + std::to_string(image.height_) + " row image.");
+
+    data_ = Memory(image.data() + (uint64_t)firstRow * width_ * channels_, size(), nullptr);
 }
 
 //getters
@@ -63,7 +97,11 @@ int Image::channels(){
 }
 
 uint8_t* Image::data(){
-    return data_;
+    return data_.data();
+}
+
+ByteSpan Image::bytes(){
+    return data_.bytes();
 }
 
 std::string Image::filename(){
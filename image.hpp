@@ -3,10 +3,12 @@
 
 #include<filesystem>
 
+#include "memory.hpp"
+
 class Image{
 
 private:
-    uint8_t *data_ = nullptr;
+	Memory data_; //allocated by stb
 	std::filesystem::path filepath_;
 	int channels_ = 0;
 	int width_ = 0;
@@ -20,13 +22,21 @@ public:
 
 //constructors and destructor
 	Image(const char *filepath);
-	~Image();
+	Image(int width, int height, int channels, const std::string filename);
+	Image(Image &image, int firstRow, int rows); //rows of another image without a copy, it must outlive the view
+
+	//move only, the pixels are handed over without a copy
+	Image(Image&&) = default;
+	Image& operator=(Image&&) = default;
+	Image(const Image&) = delete;
+	Image& operator=(const Image&) = delete;
 
 //getters
 	int height();
 	int width();
 	int channels();
 	uint8_t* data();
+	ByteSpan bytes();
 	std::string filename();
 };
 
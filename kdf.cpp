@@ -0,0 +1,259 @@
+#include "kdf.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+static inline uint32_t rotate(uint32_t x, int bits){
+    return (x << bits) | (x >> (32 - bits));
+}
+
+static inline uint32_t loadBig(const uint8_t* data){
+    return (uint32_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3];
+}
+
+static inline uint32_t loadLittle(const uint8_t* data){
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static inline void storeLittle(uint8_t* data, uint32_t value){
+    for (int i = 0; i < 4; i++)
+        data[i] = value >> (i * 8);
+}
+
+//memset that the compiler can't drop
+static void secureZero(void* data, size_t size){
+    volatile uint8_t *bytes = static_cast<volatile uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+        bytes[i] = 0;
+}
+
+//SHA-256
+
+static constexpr uint32_t roundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+struct Sha256{
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t buffer[64];
+    uint64_t length = 0;
+
+    ~Sha256(){
+        secureZero(this, sizeof(*this));
+    }
+
+    void compress(const uint8_t* block){
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++)
+            w[i] = loadBig(block + i * 4);
+
+        for (int i = 16; i < 64; i++){
+            uint32_t s0 = rotate(w[i - 15], 25) ^ rotate(w[i - 15], 14) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotate(w[i - 2], 15) ^ rotate(w[i - 2], 13) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; i++){
+            uint32_t t1 = h + (rotate(e, 26) ^ rotate(e, 21) ^ rotate(e, 7)) + ((e & f) ^ (~e & g)) + roundConstants[i] + w[i];
+            uint32_t t2 = (rotate(a, 30) ^ rotate(a, 19) ^ rotate(a, 10)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+
+    void update(const uint8_t* data, uint64_t size){
+        uint64_t buffered = length % 64;
+        length += size;
+
+        if(buffered > 0){
+            uint64_t count = size < 64 - buffered ? size : 64 - buffered;
+            std::memcpy(buffer + buffered, data, count);
+            data += count;
+            size -= count;
+
+            if(buffered + count < 64)
+                return;
+
+            compress(buffer);
+        }
+
+        for (; size >= 64; size -= 64, data += 64)
+            compress(data);
+
+        std::memcpy(buffer, data, size);
+    }
+
+    std::array<uint8_t, 32> finish(){
+        uint64_t bits = length * 8;
+
+        uint8_t padding[72] = {0x80};
+        uint64_t paddingSize = (length % 64 < 56 ? 56 : 120) - length % 64;
+        for (int i = 0; i < 8; i++)
+            padding[paddingSize + i] = bits >> (56 - i * 8);
+
+        update(padding, paddingSize + 8);
+
+        std::array<uint8_t, 32> digest;
+        for (int i = 0; i < 8; i++)
+            for (int j = 0; j < 4; j++)
+                digest[i * 4 + j] = state[i] >> (24 - j * 8);
+
+        return digest;
+    }
+};
+
+std::array<uint8_t, 32> sha256(const uint8_t* data, uint64_t size){
+    Sha256 hash;
+    hash.update(data, size);
+    return hash.finish();
+}
+
+//PBKDF2-HMAC-SHA256 with a single iteration, which is all scrypt uses
+static void pbkdf2(uint8_t* out, uint64_t outSize, const uint8_t* passphrase, uint64_t passphraseSize, const uint8_t* salt, uint64_t saltSize){
+    uint8_t key[64] = {};
+    if(passphraseSize > 64){
+        std::array<uint8_t, 32> digest = sha256(passphrase, passphraseSize);
+        std::memcpy(key, digest.data(), digest.size());
+    }
+    else if(passphraseSize > 0){
+        std::memcpy(key, passphrase, passphraseSize);
+    }
+
+    //inner and outer states after the padded key, reused for every block
+    uint8_t pad[64];
+    Sha256 inner, outer;
+
+    for (int i = 0; i < 64; i++)
+        pad[i] = key[i] ^ 0x36;
+    inner.update(pad, 64);
+
+    for (int i = 0; i < 64; i++)
+        pad[i] = key[i] ^ 0x5c;
+    outer.update(pad, 64);
+
+    for (uint32_t block = 1; outSize > 0; block++){
+        uint8_t index[4] = {uint8_t(block >> 24), uint8_t(block >> 16), uint8_t(block >> 8), uint8_t(block)};
+
+        Sha256 innerHash = inner;
+        innerHash.update(salt, saltSize);
+        innerHash.update(index, 4);
+        std::array<uint8_t, 32> digest = innerHash.finish();
+
+        Sha256 outerHash = outer;
+        outerHash.update(digest.data(), digest.size());
+        digest = outerHash.finish();
+
+        uint64_t length = outSize < 32 ? outSize : 32;
+        std::memcpy(out, digest.data(), length);
+        out += length;
+        outSize -= length;
+
+        secureZero(digest.data(), digest.size());
+    }
+
+    secureZero(key, sizeof(key));
+    secureZero(pad, sizeof(pad));
+}
+
+//scrypt mix
+
+static void salsa208(uint32_t* block){
+    uint32_t x[16];
+    std::memcpy(x, block, sizeof(x));
+
+    for (int round = 0; round < 8; round += 2){
+        x[4] ^= rotate(x[0] + x[12], 7);   x[8] ^= rotate(x[4] + x[0], 9);
+        x[12] ^= rotate(x[8] + x[4], 13);  x[0] ^= rotate(x[12] + x[8], 18);
+        x[9] ^= rotate(x[5] + x[1], 7);    x[13] ^= rotate(x[9] + x[5], 9);
+        x[1] ^= rotate(x[13] + x[9], 13);  x[5] ^= rotate(x[1] + x[13], 18);
+        x[14] ^= rotate(x[10] + x[6], 7);  x[2] ^= rotate(x[14] + x[10], 9);
+        x[6] ^= rotate(x[2] + x[14], 13);  x[10] ^= rotate(x[6] + x[2], 18);
+        x[3] ^= rotate(x[15] + x[11], 7);  x[7] ^= rotate(x[3] + x[15], 9);
+        x[11] ^= rotate(x[7] + x[3], 13);  x[15] ^= rotate(x[11] + x[7], 18);
+
+        x[1] ^= rotate(x[0] + x[3], 7);    x[2] ^= rotate(x[1] + x[0], 9);
+        x[3] ^= rotate(x[2] + x[1], 13);   x[0] ^= rotate(x[3] + x[2], 18);
+        x[6] ^= rotate(x[5] + x[4], 7);    x[7] ^= rotate(x[6] + x[5], 9);
+        x[4] ^= rotate(x[7] + x[6], 13);   x[5] ^= rotate(x[4] + x[7], 18);
+        x[11] ^= rotate(x[10] + x[9], 7);  x[8] ^= rotate(x[11] + x[10], 9);
+        x[9] ^= rotate(x[8] + x[11], 13);  x[10] ^= rotate(x[9] + x[8], 18);
+        x[12] ^= rotate(x[15] + x[14], 7); x[13] ^= rotate(x[12] + x[15], 9);
+        x[14] ^= rotate(x[13] + x[12], 13); x[15] ^= rotate(x[14] + x[13], 18);
+    }
+
+    for (int i = 0; i < 16; i++)
+        block[i] += x[i];
+}
+
+//2r blocks of 16 words, even outputs go to the first half and odd ones to the second
+static void blockMix(const uint32_t* in, uint32_t* out, uint32_t r){
+    uint32_t x[16];
+    std::memcpy(x, in + (2 * r - 1) * 16, sizeof(x));
+
+    for (uint32_t i = 0; i < 2 * r; i++){
+        for (int j = 0; j < 16; j++)
+            x[j] ^= in[i * 16 + j];
+        salsa208(x);
+
+        std::memcpy(out + ((i % 2) * r + i / 2) * 16, x, sizeof(x));
+    }
+}
+
+static void roMix(uint8_t* data, uint32_t r, uint64_t n, std::vector<uint32_t> &v){
+    uint64_t words = 32 * r;
+    std::vector<uint32_t> x(words), y(words);
+
+    for (uint64_t i = 0; i < words; i++)
+        x[i] = loadLittle(data + i * 4);
+
+    for (uint64_t i = 0; i < n; i++){
+        std::memcpy(v.data() + i * words, x.data(), words * sizeof(uint32_t));
+        blockMix(x.data(), y.data(), r);
+        x.swap(y);
+    }
+
+    for (uint64_t i = 0; i < n; i++){
+        uint64_t j = (x[words - 16] | (uint64_t)x[words - 15] << 32) & (n - 1);
+        for (uint64_t k = 0; k < words; k++)
+            x[k] ^= v[j * words + k];
+
+        blockMix(x.data(), y.data(), r);
+        x.swap(y);
+    }
+
+    for (uint64_t i = 0; i < words; i++)
+        storeLittle(data + i * 4, x[i]);
+
+    secureZero(x.data(), words * sizeof(uint32_t));
+    secureZero(y.data(), words * sizeof(uint32_t));
+}
+
+void scrypt(uint8_t* out, uint64_t outSize, const uint8_t* passphrase, uint64_t passphraseSize, const uint8_t* salt, uint64_t saltSize, uint64_t n, uint32_t r, uint32_t p){
+    if(n < 2 || (n & (n - 1)) != 0 || r == 0 || p == 0)
+        throw std::runtime_error("Invalid scrypt parameters.");
+
+    std::vector<uint8_t> blocks((uint64_t)p * 128 * r);
+    pbkdf2(blocks.data(), blocks.size(), passphrase, passphraseSize, salt, saltSize);
+
+    std::vector<uint32_t> v(n * 32 * r);
+    for (uint32_t i = 0; i < p; i++)
+        roMix(blocks.data() + (uint64_t)i * 128 * r, r, n, v);
+
+    pbkdf2(out, outSize, passphrase, passphraseSize, blocks.data(), blocks.size());
+
+    secureZero(v.data(), v.size() * sizeof(uint32_t));
+    secureZero(blocks.data(), blocks.size());
+}
@@ -0,0 +1,23 @@
+#ifndef KDF_HPP
+#define KDF_HPP
+
+#include <array>
+#include <cstdint>
+
+/*
+    Passphrase key derivation with scrypt (RFC 7914): PBKDF2-HMAC-SHA256 around a memory-hard mix
+    of 128 * r * n bytes, so guessing passphrases costs the same memory as deriving them.
+*/
+
+//default cost: 32 MiB and about 0.1 s per passphrase
+inline constexpr uint64_t scryptN = 1 << 15;
+inline constexpr uint32_t scryptR = 8;
+inline constexpr uint32_t scryptP = 1;
+
+std::array<uint8_t, 32> sha256(const uint8_t* data, uint64_t size);
+
+//'n' must be a power of 2
+void scrypt(uint8_t* out, uint64_t outSize, const uint8_t* passphrase, uint64_t passphraseSize, const uint8_t* salt, uint64_t saltSize,
+            uint64_t n = scryptN, uint32_t r = scryptR, uint32_t p = scryptP);
+
+#endif
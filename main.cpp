@@ -1,515 +1,620 @@
 #include <iostream>
 #include <filesystem>
-#include <thread>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <array>
 
-#include "tiny-aes/aes.h"
 #include "image.hpp"
 #include "file.hpp"
+#include "header.hpp"
+#include "stats.hpp"
+#include "arena.hpp"
+#include "memory.hpp"
+#include "numa.hpp"
+#include "stego.hpp"
+#include "wipe.hpp"
+
+//entries after the first one are saved with their number after the image name
+std::string entryName(Image &inputImage, size_t index){
+    return index == 0 ? inputImage.filename() : inputImage.filename() + '_' + std::to_string(index + 1);
+}
 
-std::string headerMarker = "MSGSTART"; //can change it with you own 8 byte marker
-
-unsigned int numThreads = std::thread::hardware_concurrency(); //can be changed according to the system
-
-/*
-    Header Structure:
-        - Mode (1 bit): 
-            Indicates the LSB mode for reading and storing message:
-            0 -> 1 LSB per pixel channel
-            1 -> 2 LSBs per pixel channel
-        - "MSGSTART" Marker (8 bytes / 64 bits): 
-            A fixed ASCII marker ("MSGSTART") that confirms the presence of a data in the image.
-        - Data Size (8 bytes / 64 bits):
-            Specifies the size of the data in bytes.
-
-    // total header size = 1 + 64 + 64 = 129bits
-
-    Hidden File Data:
-        - Variable Length Data: The actual file data follows the header and is encoded based on the LSB mode.
-        - Variable Length Extension: stored in reverse separating by null character. Example: [data][data]...[data]['\0'][t][x][t][.]
-
-    Encrypton:
-        header marker + data size = 128 bits are encrypted using AES in ECB mode with 128 bit Counter(Initialization Vector) as key.
-
-        and the variable size file data is encrypted using AES in CTR mode with Key and Counter.
+void retrieveData(Image &inputImage, Key *inputKey, const Entry &entry, const std::string &name){
 
-*/
+    const Header &header = entry.header;
+    uint64_t dataIterator = entry.dataIterator;
 
-//increments counter by 'n' instead of 1
-void incrementCounter(uint8_t* counter, uint64_t carry) {
-    for (int i = AES_BLOCKLEN - 1; i >= 0 && carry > 0; --i) {
-        uint64_t sum = counter[i] + carry;
-        counter[i] = sum & UINT8_MAX; // Store the lower 8 bits
-        carry = sum >> 8; // Carry over the remaining bits
-    }
-}
+    //every entry has its own cipher section
+    if(inputKey)
+        inputKey->useCipher(header.cipher, header.keySize);
 
-//inserts file inside the image in chunks
-void insertChunk(uint8_t* imgData, uint64_t imgIterator, uint8_t* fileData, uint64_t chunkSize, uint8_t mode, uint8_t channels) {
+    //retrieving the data into the file using threads
+    Memory fileData = Memory::arena(header.dataSize);
+    extractData(inputImage, inputKey, header, dataIterator, 0, header.dataSize, fileData.data());
 
-    for (uint64_t fileIterator = 0; fileIterator < chunkSize; fileIterator++){
-        for (uint8_t j = 0; j < 8; j += mode){
-            if(channels % 2 == 0 && (imgIterator % channels) == channels - 1)
-                imgIterator++;
-            
-            imgData[imgIterator] = (~((1<<mode) - 1) & imgData[imgIterator]) | ((fileData[fileIterator]>>j) & ((1<<mode) - 1));
-            imgIterator++;
-        }
+    if(header.flags & Header::compressedFlag){
+        Memory original = Memory::arena(header.originalSize);
+        decompressData(header, 0, header.blockCount(), fileData.data(), original.data());
+        fileData = std::move(original);
     }
-}
 
-//without encryption insertData
-void insertData(Image &inputImage, File &inputFile){
-    
-    uint8_t *imgData = inputImage.data();
-    uint8_t *fileData = inputFile.data();
+    File outputFile(name, std::move(fileData));
 
-    uint64_t imgIterator = 0;
+    outputFile.save();
 
-    uint64_t fileSize = inputFile.size();
-    uint8_t channels = inputImage.channels();
+    std::cout<<"File retrieved successfully\n";
+}
 
-    uint8_t mode = 1;
+//retrieves only bytes [offset, offset + size) of the hidden file, the rest of the data is not touched
+void retrieveRange(Image &inputImage, Key *inputKey, const Entry &entry, const std::string &name, uint64_t offset, uint64_t size){
 
-    if(fileSize > ((inputImage.size_no_alpha() - 1) / 8) - headerMarker.length() - sizeof(uint64_t))
-        mode = 2;
+    const Header &header = entry.header;
+    uint64_t dataIterator = entry.dataIterator;
 
-    //inserting mode
-    imgData[imgIterator++] = (~1 & imgData[imgIterator]) | (mode - 1);
+    if(inputKey)
+        inputKey->useCipher(header.cipher, header.keySize);
 
-    //inserting marker
-    for (char c : headerMarker){
-        for (uint8_t j = 0; j < 8; j += mode){
-            if(channels % 2 == 0 && (imgIterator % channels) == channels - 1)
-                imgIterator++;
+    std::string extension = readExtension(inputImage, inputKey, header, dataIterator);
+    uint64_t originalSize = header.fileSize() - extension.length() - 1;
 
-            imgData[imgIterator] = (~((1<<mode) - 1) & imgData[imgIterator]) | ((c>>j) & ((1<<mode) - 1));
-            imgIterator++;
-        }
-    }
-    
-    //inserting size
-    for (uint8_t j = 0; j < sizeof(uint64_t) * 8; j += mode){
-        if(channels % 2 == 0 && (imgIterator % channels) == channels - 1)
-            imgIterator++;
-
-        imgData[imgIterator] = (~((1<<mode) - 1) & imgData[imgIterator]) | ((fileSize>>j) & ((1<<mode) - 1));
-        imgIterator++;
-    }
-    
+    if(offset >= originalSize)
+        throw std::runtime_error("Range starts after the end of the file.\nThe file is " + std::to_string(originalSize) + " bytes.");
 
-    // inserting file data through threads
-    std::vector<std::thread> threads;
-    uint64_t fileIterator = 0, chunkSize = fileSize / numThreads;
+    size = std::min(size, originalSize - offset);
 
-    for (unsigned int i = 0; i < numThreads - 1; ++i) {
+    //range followed by the extension, the same way it is stored in the image
+    uint64_t fileSize = size + extension.length() + 1;
+    Memory fileData = Memory::arena(fileSize);
+    readFileData(inputImage, inputKey, header, dataIterator, offset, size, fileData.data());
 
-        threads.emplace_back(insertChunk, imgData, imgIterator, (fileData + fileIterator), chunkSize, mode, channels);
+    fileData.data()[size] = '\0';
+    std::copy(extension.rbegin(), extension.rend(), fileData.data() + size + 1);
 
-        fileIterator += chunkSize;
+    File outputFile(name + '_' + std::to_string(offset) + '-' + std::to_string(offset + size), std::move(fileData));
 
-        if(channels % 2 == 0){
-            imgIterator += ((chunkSize * (8 / mode)) / (channels - 1)) * channels; //adding skipped alpha channels too
+    outputFile.save();
 
-            //remaining bits not in block length of channels, loop will run 2 times at max so O(1) time
-            uint8_t rem_bits = (chunkSize * (8 / mode)) % (channels - 1);
-            while (rem_bits > 0){
-                if((imgIterator % channels) != channels - 1)
-                    rem_bits--;
-                imgIterator++;
-            }
-        }
-        else{
-            imgIterator += (chunkSize * (8 / mode));
-        }
-    }
+    std::cout<<"File range retrieved successfully\n";
+}
 
-    chunkSize += fileSize % numThreads; //remaining file data will be processed by main thread
-    insertChunk(imgData, imgIterator, (fileData + fileIterator), chunkSize, mode, channels);
+//removes "name value" from args and returns the value, empty if the option is not present
+std::string takeOption(std::vector<std::string> &args, const std::string &name) {
+    auto it = std::find(args.begin(), args.end(), name);
+    if(it == args.end())
+        return "";
 
-    for (std::thread &thread : threads)
-        thread.join();
+    if(it + 1 == args.end())
+        throw std::runtime_error("Missing value for " + name + ". Use -h for help.");
 
-    std::cout<<"File inserted successfully\n";
+    std::string value = *(it + 1);
+    args.erase(it, it + 2);
 
+    return value;
 }
 
-//with encryption insertData
-void insertData(Image &inputImage, File &inputFile, Key &inputKey){
-    
-    uint8_t *imgData = inputImage.data();
-    uint8_t *fileData = inputFile.data();
-
-    uint64_t imgIterator = 0;
-
-    uint64_t fileSize = inputFile.size();
-    uint8_t channels = inputImage.channels();
-
-    AES_ctx ctx;
-    uint8_t *iv = inputKey.IV();
-    uint8_t *key = inputKey.key();
+//removes every "name value" from args and returns the values in order
+std::vector<std::string> takeOptions(std::vector<std::string> &args, const std::string &name) {
+    std::vector<std::string> values;
+    for (std::string value = takeOption(args, name); !value.empty(); value = takeOption(args, name))
+        values.push_back(value);
 
+    return values;
+}
 
-    uint8_t mode = 1;
+//removes "name" from args, returns true if it was present
+bool takeFlag(std::vector<std::string> &args, const std::string &name) {
+    auto it = std::find(args.begin(), args.end(), name);
+    if(it == args.end())
+        return false;
 
-    if(fileSize > ((inputImage.size_no_alpha() - 1) / 8) - headerMarker.length() - sizeof(uint64_t))
-        mode = 2;
+    args.erase(it);
+    return true;
+}
 
-    //inserting mode
-    imgData[imgIterator++] = (~1 & imgData[imgIterator]) | (mode - 1);
+//parses "<offset>:<len>"
+void parseRange(const std::string &range, uint64_t &offset, uint64_t &size) {
+    size_t separator = range.find(':');
 
-    //inserting encrypted (marker + filesize) 128 bits with IV 128 bits using ECB
-    uint8_t headerData[AES_BLOCKLEN];
+    try{
+        if(separator == std::string::npos || range[0] == '-' || range[separator + 1] == '-')
+            throw std::invalid_argument(range);
 
-    for (int i = 0; i < 8; i++)
-        headerData[i] = headerMarker[i];
-    
-    for (int i = 0; i < 8; i++)
-        headerData[8 + i] = (fileSize >> (i * 8)) & UINT8_MAX;
+        size_t end = 0;
+        offset = std::stoull(range.substr(0, separator), &end);
+        if(end != separator)
+            throw std::invalid_argument(range);
 
-    AES_init_ctx(&ctx, iv); //using iv as key to encrypt header in ECB
-    AES_ECB_encrypt(&ctx, headerData);
-    
-    for (uint8_t i = 0; i < AES_BLOCKLEN; i++){
-        for (uint8_t j = 0; j < 8; j += mode){
-            if(channels % 2 == 0 && (imgIterator % channels) == channels - 1)
-                imgIterator++;
-            
-            imgData[imgIterator] = (~((1<<mode) - 1) & imgData[imgIterator]) | ((headerData[i]>>j) & ((1<<mode) - 1));
-            imgIterator++;
-        }
+        size = std::stoull(range.substr(separator + 1), &end);
+        if(end != range.length() - separator - 1)
+            throw std::invalid_argument(range);
+    }
+    catch(const std::logic_error&){
+        throw std::runtime_error("Invalid range: \"" + range + "\". Expected <offset>:<len>.");
     }
 
-    //inserting file data
-    AES_init_ctx_iv(&ctx, key, iv);
-
-    uint64_t fileIterator = 0, chunkSize = (fileSize / (numThreads * AES_KEYLEN)) * AES_KEYLEN;
-    std::vector<std::thread> threads;
-
-    for (unsigned int i = 0; i < numThreads - 1; ++i) {
-
-        threads.emplace_back([imgData, imgIterator, fileData, fileIterator, chunkSize, mode, channels](AES_ctx ctx) {
-            AES_CTR_xcrypt_buffer(&ctx, (fileData + fileIterator), chunkSize);
-            insertChunk(imgData, imgIterator, (fileData + fileIterator), chunkSize, mode, channels);
-        }, ctx);
+    if(size == 0)
+        throw std::runtime_error("Invalid range: \"" + range + "\". Length must be greater than 0.");
+}
 
-        fileIterator += chunkSize;
+//parses an entry number from 1, returns its index from 0
+uint32_t parseEntry(const std::string &entry) {
+    if (entry.empty() || entry.find_first_not_of("0123456789") != std::string::npos || entry.length() > 9 || std::stoul(entry) == 0)
+        throw std::runtime_error("Invalid entry \"" + entry + "\". Expected a number from 1.");
 
-        if(channels % 2 == 0){
-            imgIterator += ((chunkSize * (8 / mode)) / (channels - 1)) * channels;
+    return std::stoul(entry) - 1;
+}
 
-            uint8_t rem_bits = (chunkSize * (8 / mode)) % (channels - 1);
-            while (rem_bits > 0){
-                if((imgIterator % channels) != channels - 1)
-                    rem_bits--;
-                imgIterator++;
-            }
-        }
-        else{
-            imgIterator += (chunkSize * (8 / mode));
-        }
+//parses the AES key size in bytes
+uint8_t parseKeySize(const std::string &keySize) {
+    if (keySize != "16" && keySize != "24" && keySize != "32")
+        throw std::runtime_error("Invalid key size \"" + keySize + "\". Expected 16, 24 or 32.");
 
-        incrementCounter(ctx.Iv, chunkSize / AES_KEYLEN);
-    }
+    return std::stoul(keySize);
+}
 
-    chunkSize += fileSize % (numThreads * AES_KEYLEN); //add remaining file for the main thread to process
-    AES_CTR_xcrypt_buffer(&ctx, (fileData + fileIterator), chunkSize);
-    insertChunk(imgData, imgIterator, (fileData + fileIterator), chunkSize, mode, channels);
+//parses the number of keys to generate, at most maxKeyCount
+uint64_t parseCount(const std::string &count) {
+    const uint64_t maxKeyCount = 1000000;
 
-    for (std::thread &thread : threads)
-        thread.join();
+    if (count.empty() || count.find_first_not_of("0123456789") != std::string::npos || count.length() > 7 || std::stoul(count) == 0 || std::stoul(count) > maxKeyCount)
+        throw std::runtime_error("Invalid key count \"" + count + "\". Expected a number from 1 to " + std::to_string(maxKeyCount) + '.');
 
-    std::cout<<"File inserted successfully\n";
-    
+    return std::stoul(count);
 }
 
-//retreives file inside the image in chunks
-void retrieveChunk(uint8_t* imgData, uint64_t imgIterator, uint8_t* fileData, uint64_t chunkSize, uint8_t mode, uint8_t channels) {
-    for(uint64_t fileIterator = 0; fileIterator < chunkSize; fileIterator++) {
-        uint8_t tempByte = 0;
-        
-        for (uint8_t j = 0; j < 8; j += mode){
-
-            if(channels % 2 == 0 && (imgIterator % channels) == channels - 1)
-                imgIterator++;
+//parses "<x>,<y>,<w>,<h>"
+std::array<uint32_t, 4> parseRoi(const std::string &roi) {
+    std::array<uint32_t, 4> values{};
+    std::stringstream stream(roi);
+    std::string field;
 
-            tempByte |= (imgData[imgIterator] & ((1<<mode) - 1)) << j;
+    for (size_t i = 0; i < values.size(); i++){
+        if(!std::getline(stream, field, ',') || field.empty() || field.find_first_not_of("0123456789") != std::string::npos || field.length() > 9)
+            throw std::runtime_error("Invalid region of interest: \"" + roi + "\". Expected <x>,<y>,<w>,<h>.");
 
-            imgIterator++;
-        }
-        
-        fileData[fileIterator] = tempByte;
+        values[i] = std::stoul(field);
     }
-}
 
-//without encryption retrieveData
-void retrieveData(Image &inputImage){
+    if(std::getline(stream, field) || values[2] == 0 || values[3] == 0)
+        throw std::runtime_error("Invalid region of interest: \"" + roi + "\". Expected <x>,<y>,<w>,<h> with a width and height greater than 0.");
 
-    uint8_t *imgData = inputImage.data();
-    uint8_t channels = inputImage.channels();
-    uint64_t imgSize = inputImage.size();
+    return values;
+}
 
-    uint64_t imgIterator = 0, fileSize = 0;
+void printHelp(char* program) {
+    std::string progName = std::filesystem::path(program).stem().string();
 
-    //retrieving mode
-    uint8_t mode = (imgData[imgIterator++] & 1) + 1;
+    std::cout << "\nUsage:\n";
+    std::cout << "  ./" << progName << " <mode> [options]\n\n";
 
-    //check if there is a message or not from marker
-    for (char c : headerMarker) {
-        char temp = 0;
+    std::cout << "Modes:\n";
+    std::cout << "  -h, --help      Display this help message and exit.\n";
+    std::cout << "  -k, --key       Generate an encryption key and save it to a file.\n";
+    std::cout << "                  Usage: ./" << progName << " --key <filename> [--key-size <16|24|32>] [--count <n> | --passphrase <text>]\n";
+    std::cout << "                    --key-size   - Key size in bytes for AES-128/192/256 (default 16).\n";
+    std::cout << "                    --count      - Generate <n> keys (1 to 1000000) named <filename>_1 to <filename>_<n>,\n";
+    std::cout << "                                   numbers zero padded to the digits of <n> (batch_0001 to batch_1000).\n";
+    std::cout << "                    --passphrase - Derive the key from a passphrase (scrypt) instead of random bytes.\n\n";
 
-        for (uint8_t j = 0; j < 8; j += mode){
-            if(channels % 2 == 0 && (imgIterator % channels) == channels - 1)
-                imgIterator++;
+    std::cout << "  -i, --insert    Embed a file into an image using optional encryption.\n";
+    std::cout << "                  Usage: ./" << progName << " --insert <image> <file> [key] [--compress] [--cipher <aes|chacha20>] [--authenticate]\n";
+    std::cout << "                         [--layout <linear|scatter|tiled>] [--matching] [--coding <hamming|stc>] [--adaptive] [--roi <x>,<y>,<w>,<h>]\n";
+    std::cout << "                         ./" << progName << " --insert <image> --slot <file>[,<key>] --slot <file>[,<key>] ... [options]\n";
+    std::cout << "                    <image>    - Path to the image file.\n";
+    std::cout << "                    <file>     - Path to the file to hide.\n";
+    std::cout << "                    [key]      - Optional encryption key file path.\n";
+    std::cout << "                    --compress - Compress the file before hiding it.\n";
+    std::cout << "                    --cipher   - Cipher for the file data with a key (default aes),\n";
+    std::cout << "                                 chacha20 is faster on cpus without AES instructions (16 or 32 byte keys).\n";
+    std::cout << "                    --authenticate - Store a Poly1305 tag for every chunk and the header (needs a key),\n";
+    std::cout << "                                     retrieval then fails if the image was modified.\n";
+    std::cout << "                    --layout   - Order of the data channels (needs a key for scatter and tiled, default linear),\n";
+    std::cout << "                                 scatter spreads the data over the whole image in a key-dependent order,\n";
+    std::cout << "                                 tiled does the same inside cache-sized tiles and is faster.\n";
+    std::cout << "                    --matching - Move channels up or down by 1 (LSB matching) instead of overwriting their LSBs,\n";
+    std::cout << "                                 which is harder to detect. Retrieval is the same.\n";
+    std::cout << "                    --coding   - Syndrome code the data at 1 LSB so fewer channels change per bit:\n";
+    std::cout << "                                 hamming is fast, stc (syndrome-trellis codes) changes the fewest channels.\n";
+    std::cout << "                                 Capacity is lower, the most efficient code that fits is used.\n";
+    std::cout << "                    --adaptive - Put the data only in textured and edge areas of the image, where changes are\n";
+    std::cout << "                                 hardest to see (linear layout, no --matching, with stc flips follow the texture too).\n";
+    std::cout << "                    --roi      - Only change the pixels of a rectangle (linear layout, not with --adaptive), row by row.\n";
+    std::cout << "                                 The header still takes the first pixels of the image, the rectangle must start after it.\n";
+    std::cout << "                    --slot     - Hide several files for different keys in one image, each in its own band of rows.\n";
+    std::cout << "                                 Every key retrieves only its own file, the other slots are not read.\n\n";
+
+    std::cout << "  -a, --append    Hide another file after the data already in a stego image, which is not rewritten.\n";
+    std::cout << "                  Usage: ./" << progName << " --append <image> <file> [key] [insert options except --roi and --slot]\n";
+    std::cout << "                    The existing data has to be readable with the same key and use the linear layout,\n";
+    std::cout << "                    without --adaptive or --roi. Every appended file is a new entry of the image.\n\n";
+
+    std::cout << "  -u, --update    Replace a hidden file with a new version of the same size, only the changed chunks are embedded again.\n";
+    std::cout << "                  Usage: ./" << progName << " --update <image> <file> [key] [--entry <n>]\n";
+    std::cout << "                    --entry    - Entry of an image with appended files to update (default 1).\n";
+    std::cout << "                    Changed channels use LSB matching if the file was inserted with --matching.\n";
+    std::cout << "                    Compressed files and files hidden by older versions can't be updated.\n\n";
 
-            temp |= (imgData[imgIterator] & ((1<<mode) - 1)) << j;
-            imgIterator++;
-        }
-        
-        if (temp != c) {
-            std::cout<<"No data found in this image.\n";
-            return;
-        }
-    }
+    std::cout << "  -r, --retrieve  Extract hidden data from an image.\n";
+    std::cout << "                  Usage: ./" << progName << " --retrieve <image> [key] [--range <offset>:<len>] [--entry <n>]\n";
+    std::cout << "                    <image> - Path to the steganographic image.\n";
+    std::cout << "                    [key]   - Optional encryption key file path.\n";
+    std::cout << "                    --range - Extract only <len> bytes of the file starting at <offset>.\n";
+    std::cout << "                    --entry - Extract only the <n>th file of an image with appended files (default all,\n";
+    std::cout << "                              entry 2 onwards are saved as <name>_<n>, --range uses entry 1 by default).\n\n";
+
+    std::cout << "  -w, --wipe      Overwrite the low bits of every pixel channel with noise to destroy any hidden data.\n";
+    std::cout << "                  Usage: ./" << progName << " --wipe <image> [--bits <n>] [--zero] [--payload [key]]\n";
+    std::cout << "                    --bits    - Number of LSB planes to wipe, 1 to 8 (default 1).\n";
+    std::cout << "                    --zero    - Clear the bits instead of randomizing them.\n";
+    std::cout << "                    --payload - Only wipe up to the end of the data found with the key (or without one),\n";
+    std::cout << "                                at least as many planes as the data uses. Alpha is never changed.\n\n";
+
+    std::cout << "Options for --insert, --append, --update and --retrieve:\n";
+    std::cout << "  --passphrase <text>  Use a key derived from a passphrase instead of a key file (AES-256 by default).\n";
+    std::cout << "  --stats              Print time, bytes processed and throughput of every stage.\n";
+    std::cout << "  --stats-json <file>  Write the same stats as JSON.\n";
+    std::cout << "  --trace <file>       Write a Chrome/Perfetto trace with one track per worker thread.\n";
+    std::cout << "  --prefault           Map the pages of large buffers on all threads before they are used.\n";
+    std::cout << "  --no-hugepages       Don't align large buffers to 2 MB or advise huge pages for them.\n";
+    std::cout << "  --numa <mode>        local: pin workers to nodes and place image pages on the node that processes them.\n";
+    std::cout << "                       interleave: spread image pages over all nodes.\n\n";
 
-    //retrieving size of data
-    for (uint8_t j = 0; j < sizeof(int64_t) * 8; j += mode) {
-        if(channels % 2 == 0 && (imgIterator % channels) == channels - 1)
-            imgIterator++;
+    std::cout << "Examples:\n";
+    std::cout << "  ./" << progName << " --key mykey\n";
+    std::cout << "  ./" << progName << " --key mykey256 --key-size 32\n";
+    std::cout << "  ./" << progName << " --key batch --count 1000\n";
+    std::cout << "  ./" << progName << " --insert image.png secret.txt --passphrase \"correct horse battery staple\"\n";
+    std::cout << "  ./" << progName << " --insert image.png secret.txt keys/mykey.key\n";
+    std::cout << "  ./" << progName << " --insert image.png logs.txt keys/mykey.key --compress\n";
+    std::cout << "  ./" << progName << " --insert image.png secret.txt keys/mykey256.key --cipher chacha20\n";
+    std::cout << "  ./" << progName << " --insert image.png secret.txt keys/mykey.key --authenticate\n";
+    std::cout << "  ./" << progName << " --insert image.png secret.txt keys/mykey.key --layout tiled\n";
+    std::cout << "  ./" << progName << " --insert image.png secret.txt keys/mykey.key --matching\n";
+    std::cout << "  ./" << progName << " --insert image.png secret.txt --coding stc\n";
+    std::cout << "  ./" << progName << " --insert image.png secret.txt --coding stc --adaptive\n";
+    std::cout << "  ./" << progName << " --insert image.png secret.txt --roi 0,64,1920,256\n";
+    std::cout << "  ./" << progName << " --insert image.png --slot alice.txt,keys/alice.key --slot bob.txt,keys/bob.key\n";
+    std::cout << "  ./" << progName << " --append output/image_i.png notes.txt keys/mykey.key\n";
+    std::cout << "  ./" << progName << " --update output/image_i.png config.json keys/mykey.key\n";
+    std::cout << "  ./" << progName << " --retrieve output/image_i.png keys/mykey.key\n";
+    std::cout << "  ./" << progName << " --retrieve output/image_i_i.png keys/mykey.key --entry 2\n";
+    std::cout << "  ./" << progName << " --retrieve output/image_i.png keys/mykey.key --range 1024:4096\n";
+    std::cout << "  ./" << progName << " --wipe upload.png --bits 2\n";
+    std::cout << "  ./" << progName << " --wipe output/image_i.png --payload keys/mykey.key\n";
+    std::cout << "  ./" << progName << " --insert image.png secret.txt --stats\n\n";
+}
 
-        fileSize |= uint64_t((imgData[imgIterator] & ((1<<mode) - 1))) << j;
-        imgIterator++;
-    }
-    
-    if(fileSize < 1 || fileSize > (mode * (inputImage.size_no_alpha() - 1) / 8) - headerMarker.length() - sizeof(int64_t)){
-        std::cout << "Corrupted header. The message length in the header is invalid. Cannot retrieve the file.\n";
-        return;
-    }
 
-    //retrieving the data into the file using threads
-    uint8_t *fileData = new uint8_t[fileSize];
-    uint64_t fileIterator = 0, chunkSize = fileSize / numThreads;
+int main(int argc, char* argv[]) {
 
-    std::vector<std::thread> threads;
+    try {
+        if (argc < 2)
+            throw std::runtime_error("Invalid usage. Use \"./" + std::filesystem::path(argv[0]).stem().string() + " -h\" for help.");
 
-    for (unsigned int i = 0; i < numThreads - 1; ++i) {
+        std::vector<std::string> args(argv + 1, argv + argc);
+        std::string mode(args[0]);
 
-        threads.emplace_back(retrieveChunk, imgData, imgIterator, (fileData + fileIterator), chunkSize, mode, channels);
+        bool inserting = mode == "-i" || mode == "--insert" || mode == "-a" || mode == "--append";
 
-        fileIterator += chunkSize;
+        std::string range = takeOption(args, "--range");
+        if (!range.empty() && mode != "-r" && mode != "--retrieve")
+            throw std::runtime_error("--range can only be used with --retrieve. Use -h for help.");
 
-        if(channels % 2 == 0){
-            imgIterator += ((chunkSize * (8 / mode)) / (channels - 1)) * channels; //adding skipped alpha channels too
+        bool updating = mode == "-u" || mode == "--update";
 
-            //remaining bits not in block length of channels, loop will run 2 times at max so O(1) time
-            uint8_t rem_bits = (chunkSize * (8 / mode)) % (channels - 1);
-            while (rem_bits > 0){
-                if((imgIterator % channels) != channels - 1)
-                    rem_bits--;
-                imgIterator++;
-            }
-        }
-        else{
-            imgIterator += (chunkSize * (8 / mode));
-        }
-        
-    }
+        std::string entry = takeOption(args, "--entry");
+        if (!entry.empty() && mode != "-r" && mode != "--retrieve" && !updating)
+            throw std::runtime_error("--entry can only be used with --retrieve or --update. Use -h for help.");
 
-    chunkSize += fileSize % numThreads; //remaining file data will be processed by main thread
-    retrieveChunk(imgData, imgIterator, (fileData + fileIterator), chunkSize, mode, channels);
+        std::string keySize = takeOption(args, "--key-size");
+        if (!keySize.empty() && mode != "-k" && mode != "--key")
+            throw std::runtime_error("--key-size can only be used with --key. Use -h for help.");
 
-    for (std::thread &thread : threads)
-        thread.join();
+        std::string count = takeOption(args, "--count");
+        if (!count.empty() && mode != "-k" && mode != "--key")
+            throw std::runtime_error("--count can only be used with --key. Use -h for help.");
 
-    File outputFile(inputImage.filename(), fileData, fileSize);
+        std::string passphrase = takeOption(args, "--passphrase");
 
-    outputFile.save();
+        std::string cipher = takeOption(args, "--cipher");
+        if (!cipher.empty() && !inserting)
+            throw std::runtime_error("--cipher can only be used with --insert or --append. Use -h for help.");
 
-    std::cout<<"File retrieved successfully\n";
+        if (!cipher.empty() && cipher != "aes" && cipher != "chacha20")
+            throw std::runtime_error("Invalid cipher \"" + cipher + "\", expected aes or chacha20.");
 
-}
+        bool authenticate = takeFlag(args, "--authenticate");
+        if (authenticate && !inserting)
+            throw std::runtime_error("--authenticate can only be used with --insert or --append. Use -h for help.");
 
-//without encryption retrieveData
-void retrieveData(Image &inputImage, Key &inputKey){
+        bool compress = takeFlag(args, "--compress");
+        if (compress && !inserting)
+            throw std::runtime_error("--compress can only be used with --insert or --append. Use -h for help.");
 
-    uint8_t *imgData = inputImage.data();
-    uint8_t channels = inputImage.channels();
-    uint64_t imgSize = inputImage.size();
+        std::string layout = takeOption(args, "--layout");
+        if (!layout.empty() && !inserting)
+            throw std::runtime_error("--layout can only be used with --insert or --append. Use -h for help.");
 
-    uint64_t imgIterator = 0, fileSize = 0;
+        bool matching = takeFlag(args, "--matching");
+        if (matching && !inserting)
+            throw std::runtime_error("--matching can only be used with --insert or --append, --update uses what the file was inserted with. Use -h for help.");
 
-    AES_ctx ctx;
-    uint8_t *iv = inputKey.IV();
-    uint8_t *key = inputKey.key();
+        std::string coding = takeOption(args, "--coding");
+        if (!coding.empty() && !inserting)
+            throw std::runtime_error("--coding can only be used with --insert or --append. Use -h for help.");
 
-    //retrieving mode
-    uint8_t mode = (imgData[imgIterator++] & 1) + 1;
+        std::vector<std::string> slots = takeOptions(args, "--slot");
+        if (!slots.empty() && mode != "-i" && mode != "--insert")
+            throw std::runtime_error("--slot can only be used with --insert. Use -h for help.");
 
-    //check if there is a message or not from marker
-    uint8_t headerData[AES_BLOCKLEN];
+        std::string roi = takeOption(args, "--roi");
+        if (!roi.empty() && mode != "-i" && mode != "--insert")
+            throw std::runtime_error("--roi can only be used with --insert. Use -h for help.");
 
-    for(uint64_t i = 0; i < AES_BLOCKLEN; i++) {
-        uint8_t tempByte = 0;
-        
-        for (uint8_t j = 0; j < 8; j += mode){
+        bool adaptive = takeFlag(args, "--adaptive");
+        if (adaptive && !inserting)
+            throw std::runtime_error("--adaptive can only be used with --insert or --append. Use -h for help.");
 
-            if(channels % 2 == 0 && (imgIterator % channels) == channels - 1)
-                imgIterator++;
+        bool wiping = mode == "-w" || mode == "--wipe";
 
-            tempByte |= (imgData[imgIterator] & ((1<<mode) - 1)) << j;
+        bool zero = takeFlag(args, "--zero");
+        if (zero && !wiping)
+            throw std::runtime_error("--zero can only be used with --wipe. Use -h for help.");
 
-            imgIterator++;
-        }
-        
-        headerData[i] = tempByte;
-    }
+        bool payload = takeFlag(args, "--payload");
+        if (payload && !wiping)
+            throw std::runtime_error("--payload can only be used with --wipe. Use -h for help.");
 
-    AES_init_ctx(&ctx, iv);
-    AES_ECB_decrypt(&ctx, headerData);
+        std::string bits = takeOption(args, "--bits");
+        if (!bits.empty() && !wiping)
+            throw std::runtime_error("--bits can only be used with --wipe. Use -h for help.");
 
-    for (int i = 0; i < 8; i++){
-        if(headerData[i] != headerMarker[i]){
-            std::cout<<"No data found in this image.\n";
-            return;
-        }
-    }
-        
-    for (int i = 0; i < 8; i++)
-        fileSize |= uint64_t(headerData[8 + i]) << (i * 8);
-    
-    if(fileSize < 1 || fileSize > (mode * (inputImage.size_no_alpha() - 1) / 8) - headerMarker.length() - sizeof(int64_t)){
-        std::cout << "Corrupted header. The message length in the header is invalid. Cannot retrieve the message.\n";
-        return;
-    }
+        if (!bits.empty() && (bits.length() != 1 || bits[0] < '1' || bits[0] > '8'))
+            throw std::runtime_error("Invalid bits \"" + bits + "\", expected 1 to 8.");
 
-    //retrieving the data into the file using threads
-    uint8_t *fileData = new uint8_t[fileSize];
+        InsertOptions options;
+        options.compress = compress;
+        options.authenticate = authenticate;
+        options.matching = matching;
+        options.adaptive = adaptive;
+        if (!roi.empty())
+            options.roi = parseRoi(roi);
 
-    uint64_t fileIterator = 0, chunkSize = (fileSize / (numThreads * AES_KEYLEN)) * AES_KEYLEN;
+        if (layout == "scatter")
+            options.layout = Header::scatter;
+        else if (layout == "tiled")
+            options.layout = Header::tiled;
+        else if (!layout.empty() && layout != "linear")
+            throw std::runtime_error("Invalid layout \"" + layout + "\", expected linear, scatter or tiled.");
 
-    AES_init_ctx_iv(&ctx, key, iv);
+        if (coding == "hamming")
+            options.coding = Header::hamming;
+        else if (coding == "stc")
+            options.coding = Header::stc;
+        else if (!coding.empty())
+            throw std::runtime_error("Invalid coding \"" + coding + "\", expected hamming or stc.");
 
-    std::vector<std::thread> threads;
+        bool stats = takeFlag(args, "--stats");
+        std::string statsJson = takeOption(args, "--stats-json");
+        std::string trace = takeOption(args, "--trace");
+        Stats::enabled = stats || !statsJson.empty() || !trace.empty();
+
+        Arena::prefault = takeFlag(args, "--prefault");
+        Arena::hugePages = !takeFlag(args, "--no-hugepages");
+
+        std::string numa = takeOption(args, "--numa");
+        if (numa == "local")
+            numaMode = Numa::local;
+        else if (numa == "interleave")
+            numaMode = Numa::interleave;
+        else if (!numa.empty())
+            throw std::runtime_error("Invalid NUMA mode \"" + numa + "\", expected local or interleave.");
 
-    for (unsigned int i = 0; i < numThreads - 1; ++i) {            
+        if (numThreads == 0)
+            numThreads = 1;
 
-        threads.emplace_back([imgData, imgIterator, fileData, fileIterator, chunkSize, mode, channels](AES_ctx ctx) {
-            retrieveChunk(imgData, imgIterator, (fileData + fileIterator), chunkSize, mode, channels);
-            AES_CTR_xcrypt_buffer(&ctx, (fileData + fileIterator), chunkSize);
-        }, ctx);
+        if (mode == "-h" || mode == "--help"){
+            printHelp(argv[0]);
+        }
+        else if ((mode == "-k" || mode == "--key") && args.size() == 2){
+            if (passphrase.empty())
+                Key::generateKey(args[1].c_str(), keySize.empty() ? 16 : parseKeySize(keySize), count.empty() ? 1 : parseCount(count));
+            else if (count.empty())
+                Key::fromPassphrase(passphrase, keySize.empty() ? 16 : parseKeySize(keySize)).save(args[1].c_str());
+            else
+                throw std::runtime_error("--count can't be used with --passphrase, every key would be the same.");
+        }
+        else if ((mode == "-i" || mode == "--insert") && !slots.empty() && args.size() == 2) {
+            Image inputImage(args[1].c_str());
+
+            if (!passphrase.empty())
+                throw std::runtime_error("--passphrase can't be used with --slot, every slot has its own key file. Use -h for help.");
+
+            //"<file>[,<key>]" for every slot
+            std::vector<std::unique_ptr<File>> files;
+            std::vector<std::unique_ptr<Key>> keys;
+            std::vector<File*> slotFiles;
+            std::vector<Key*> slotKeys;
+
+            for (const std::string &slot : slots) {
+                size_t comma = slot.find(',');
+                files.push_back(std::make_unique<File>(slot.substr(0, comma).c_str()));
+                keys.push_back(comma == std::string::npos ? nullptr : std::make_unique<Key>(slot.substr(comma + 1).c_str()));
+
+                if (keys.back() && cipher == "chacha20")
+                    keys.back()->useCipher(Header::chacha20, keys.back()->keySize());
+                else if (!keys.back() && (!cipher.empty() || authenticate || options.layout != Header::linear))
+                    throw std::runtime_error(std::string(authenticate ? "--authenticate" : !cipher.empty() ? "--cipher" : "--layout " + layout) + " needs a key for every slot. Use -h for help.");
+
+                slotFiles.push_back(files.back().get());
+                slotKeys.push_back(keys.back().get());
+            }
 
-        fileIterator += chunkSize;
+            std::vector<Header> headers = insertSlots(inputImage, slotFiles, slotKeys, options);
 
-        if(channels % 2 == 0){
-            imgIterator += ((chunkSize * (8 / mode)) / (channels - 1)) * channels;
+            std::cout<<headers.size()<<" files inserted successfully\n";
 
-            uint8_t rem_bits = (chunkSize * (8 / mode)) % (channels - 1);
-            while (rem_bits > 0){
-                if((imgIterator % channels) != channels - 1)
-                    rem_bits--;
-                imgIterator++;
-            }
-        }
-        else{
-            imgIterator += (chunkSize * (8 / mode));
+            inputImage.save();
         }
+        else if (inserting && (args.size() == 3 || args.size() == 4)) {
+            Image inputImage(args[1].c_str());
 
-        incrementCounter(ctx.Iv, chunkSize / AES_KEYLEN);
-    }
+            uint64_t dataSize = std::filesystem::file_size(args[2]) + std::filesystem::path(args[2]).extension().string().length() + 1;
 
-    chunkSize += fileSize % (numThreads * AES_KEYLEN); //add remaining file for the main thread to process
-    retrieveChunk(imgData, imgIterator, (fileData + fileIterator), chunkSize, mode, channels);
-    AES_CTR_xcrypt_buffer(&ctx, (fileData + fileIterator), chunkSize);
+            if (!compress)
+                checkCapacity(inputImage, dataSize);
 
-    for (std::thread &thread : threads)
-        thread.join();
+            File inputFile(args[2].c_str());
 
-    File outputFile(inputImage.filename(), fileData, fileSize);
+            std::unique_ptr<Key> inputKey;
+            if (args.size() == 4 && !passphrase.empty())
+                throw std::runtime_error("Use either a key file or --passphrase. Use -h for help.");
 
-    outputFile.save();
+            if (args.size() == 4)
+                inputKey = std::make_unique<Key>(args[3].c_str());
+            else if (!passphrase.empty())
+                inputKey = std::make_unique<Key>(Key::fromPassphrase(passphrase));
+            else if (!cipher.empty() || authenticate || options.layout != Header::linear)
+                throw std::runtime_error(std::string(authenticate ? "--authenticate" : !cipher.empty() ? "--cipher" : "--layout " + layout) + " needs a key. Use -h for help.");
 
-    std::cout<<"File retrieved successfully\n";
-}
+            if (cipher == "chacha20")
+                inputKey->useCipher(Header::chacha20, inputKey->keySize());
 
-void printHelp(char* program) {
-    std::string progName = std::filesystem::path(program).stem().string();
+            bool append = mode == "-a" || mode == "--append";
+            Header header = append ? appendData(inputImage, inputFile, inputKey.get(), options) : insertData(inputImage, inputFile, inputKey.get(), options);
 
-    std::cout << "\nUsage:\n";
-    std::cout << "  ./" << progName << " <mode> [options]\n\n";
+            if (compress)
+                std::cout<<"File compressed from "<<header.originalSize<<" to "<<header.dataSize<<" bytes\n";
 
-    std::cout << "Modes:\n";
-    std::cout << "  -h, --help      Display this help message and exit.\n";
-    std::cout << "  -k, --key       Generate a 16-byte encryption key and save it to a file.\n";
-    std::cout << "                  Usage: ./" << progName << " --key <filename>\n\n";
+            if (append)
+                std::cout<<"File appended successfully as entry "<<header.entry + 1<<'\n';
+            else
+                std::cout<<"File inserted successfully\n";
 
-    std::cout << "  -i, --insert    Embed a file into an image using optional encryption.\n";
-    std::cout << "                  Usage: ./" << progName << " --insert <image> <file> [key]\n";
-    std::cout << "                    <image> - Path to the image file.\n";
-    std::cout << "                    <file>  - Path to the file to hide.\n";
-    std::cout << "                    [key]   - Optional encryption key file path.\n\n";
+            inputImage.save();
+        }
+        else if (updating && (args.size() == 3 || args.size() == 4)) {
+            Image inputImage(args[1].c_str());
+            File inputFile(args[2].c_str());
 
-    std::cout << "  -r, --retrieve  Extract hidden data from an image.\n";
-    std::cout << "                  Usage: ./" << progName << " --retrieve <image> [key]\n";
-    std::cout << "                    <image> - Path to the steganographic image.\n";
-    std::cout << "                    [key]   - Optional encryption key file path.\n\n";
+            std::unique_ptr<Key> inputKey;
+            if (args.size() == 4 && !passphrase.empty())
+                throw std::runtime_error("Use either a key file or --passphrase. Use -h for help.");
 
-    std::cout << "Examples:\n";
-    std::cout << "  ./" << progName << " --key mykey\n";
-    std::cout << "  ./" << progName << " --insert image.png secret.txt keys/mykey.key\n";
-    std::cout << "  ./" << progName << " --retrieve output/image_i.png keys/mykey.key\n\n";
-}
+            if (args.size() == 4)
+                inputKey = std::make_unique<Key>(args[3].c_str());
+            else if (!passphrase.empty())
+                inputKey = std::make_unique<Key>(Key::fromPassphrase(passphrase));
 
+            //a slot is a view of the image rows, updating it changes the image
+            Image slotRows = slotImage(inputImage, inputKey.get());
 
-int main(int argc, char* argv[]) {
+            Update update = updateData(slotRows, inputFile, inputKey.get(), entry.empty() ? 0 : parseEntry(entry));
 
-    try {
-        if (argc < 2)
-            throw std::runtime_error("Invalid usage. Use \"./" + std::filesystem::path(argv[0]).stem().string() + " -h\" for help.");
+            std::cout<<update.bytes<<" bytes changed in "<<update.chunks<<" of "<<update.header.chunkCount()<<" chunks\n";
+            std::cout<<"File updated successfully\n";
 
-        std::string mode(argv[1]);
+            inputImage.save();
+        }
+        else if (wiping && (args.size() == 2 || (payload && args.size() == 3))) {
+            Image inputImage(args[1].c_str());
+
+            std::unique_ptr<Key> inputKey;
+            if (args.size() == 3 && !passphrase.empty())
+                throw std::runtime_error("Use either a key file or --passphrase. Use -h for help.");
+
+            if (args.size() == 3)
+                inputKey = std::make_unique<Key>(args[2].c_str());
+            else if (!passphrase.empty())
+                inputKey = std::make_unique<Key>(Key::fromPassphrase(passphrase));
+
+            uint8_t planes = bits.empty() ? 1 : bits[0] - '0';
+            uint64_t end = inputImage.size();
+
+            //only the bytes up to the end of the detected data, at least at its mode
+            uint8_t dataMode = 0;
+            if (payload) {
+                end = dataExtent(inputImage, inputKey.get(), dataMode);
+                planes = std::max(planes, dataMode);
+            }
 
-        if (numThreads == 0)
-            numThreads = 1;
+            if (end == 0) {
+                std::cout<<"No data found in this image, nothing was wiped.\n";
+            }
+            else {
+                wipePlanes(inputImage, 0, end, planes, zero);
 
-        if (mode == "-h" || mode == "--help"){
-            printHelp(argv[0]);
-        }
-        else if ((mode == "-k" || mode == "--key") && argc == 3){
-            Key::generateKey(argv[2]);
+                std::cout<<"Wiped "<<+planes<<(planes == 1 ? " LSB plane" : " LSB planes")<<" of "<<end<<" of "<<inputImage.size()<<" bytes\n";
+
+                inputImage.save();
+            }
         }
-        else if ((mode == "-i" || mode == "--insert") && (argc == 4 || argc == 5)) {
-            Image inputImage(argv[2]);
+        else if ((mode == "-r" || mode == "--retrieve") && (args.size() == 2 || args.size() == 3)) {
+            Image inputImage(args[1].c_str());
 
-            uint64_t availableBytes = (2 * (inputImage.size_no_alpha() - 1) / 8) - headerMarker.length() - sizeof(uint64_t);
+            std::unique_ptr<Key> inputKey;
+            if (args.size() == 3 && !passphrase.empty())
+                throw std::runtime_error("Use either a key file or --passphrase. Use -h for help.");
 
-            if (availableBytes < std::filesystem::file_size(argv[3]) + std::filesystem::path(argv[3]).extension().string().length() + 1)
-                throw std::runtime_error("File is too large to fit.\nThe Image can fit " + std::to_string(availableBytes) + " bytes.");
+            if (args.size() == 3)
+                inputKey = std::make_unique<Key>(args[2].c_str());
+            else if (!passphrase.empty())
+                inputKey = std::make_unique<Key>(Key::fromPassphrase(passphrase));
 
-            File inputFile(argv[3]);
+            //only the rows of the slot of the key are read in images with several payloads
+            Image slotRows = slotImage(inputImage, inputKey.get());
 
-            if (argc == 5) {
-                Key inputKey(argv[4]);
-                insertData(inputImage, inputFile, inputKey);
+            std::vector<Entry> entries = readEntries(slotRows, inputKey.get());
+            if (entries.empty()) {
+                std::cout<<"No data found in this image.\n";
             }
             else {
-                insertData(inputImage, inputFile);
-            }
-
-            inputImage.save();
-        }
-        else if ((mode == "-r" || mode == "--retrieve") && (argc == 3 || argc == 4)) {
-            Image inputImage(argv[2]);
-
-            if (argc == 4) {
-                Key inputKey(argv[3]);
-                retrieveData(inputImage, inputKey);
-            }
-            else{
-                retrieveData(inputImage);
+                size_t first = 0, last = range.empty() ? entries.size() : 1;
+                if (!entry.empty()) {
+                    first = parseEntry(entry);
+                    last = first + 1;
+
+                    if (first >= entries.size())
+                        throw std::runtime_error("Entry " + entry + " not found, the image has " + std::to_string(entries.size()) + " entries.");
+                }
+
+                for (size_t i = first; i < last; i++) {
+                    if (range.empty()) {
+                        retrieveData(slotRows, inputKey.get(), entries[i], entryName(slotRows, i));
+                    }
+                    else {
+                        uint64_t offset = 0, size = 0;
+                        parseRange(range, offset, size);
+                        retrieveRange(slotRows, inputKey.get(), entries[i], entryName(slotRows, i), offset, size);
+                    }
+                }
             }
         }
         else {
             throw std::runtime_error("Invalid mode or incorrect number of arguments. Use -h for help.");
         }
+
+        if (stats)
+            Stats::print(std::cout);
+
+        if (!statsJson.empty()) {
+            std::ofstream fout(statsJson);
+            if (!fout)
+                throw std::runtime_error("Failed to create file: " + statsJson);
+
+            Stats::printJson(fout);
+        }
+
+        if (!trace.empty()) {
+            std::ofstream fout(trace);
+            if (!fout)
+                throw std::runtime_error("Failed to create file: " + trace);
+
+            Stats::printTrace(fout);
+        }
     }
     catch(const std::exception& e)
     {
@@ -0,0 +1,77 @@
+#include "matching.hpp"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #include <immintrin.h>
+    #define MATCHING_SIMD 1
+#endif
+
+MatchNoise::MatchNoise(const uint8_t* seed) : seed_(0){
+    for (uint64_t i = 0; i < seedSize; i++)
+        seed_ |= uint64_t(seed[i]) << (i * 8);
+}
+
+//16 noise bits starting at any slot
+static inline uint32_t noiseBits(const MatchNoise &noise, uint64_t slot){
+    uint64_t shift = slot % 64;
+    uint64_t bits = noise.word(slot / 64) >> shift;
+
+    if(shift > 48)
+        bits |= noise.word(slot / 64 + 1) << (64 - shift);
+
+    return bits & 0xffff;
+}
+
+static inline void matchScalar(uint8_t* channels, uint8_t data, uint8_t signs){
+    for (int j = 0; j < 8; j++)
+        channels[j] = matchChannel(channels[j], (data >> j) & 1, 1, (signs >> j) & 1);
+}
+
+#ifdef MATCHING_SIMD
+
+//byte j of spread[b] is bit j of b
+struct SpreadTable{
+    uint64_t bytes[256];
+
+    constexpr SpreadTable() : bytes(){
+        for (int b = 0; b < 256; b++)
+            for (int j = 0; j < 8; j++)
+                bytes[b] |= uint64_t((b >> j) & 1) << (j * 8);
+    }
+};
+
+static constexpr SpreadTable spread;
+
+static inline __m128i spreadBits(uint32_t bits){
+    return _mm_set_epi64x(spread.bytes[(bits >> 8) & 0xff], spread.bytes[bits & 0xff]);
+}
+
+//mismatched channels move up where the noise says so or at 0, down otherwise or at 255, saturating add/sub never wrap
+static inline void match16(uint8_t* channels, uint32_t data, uint32_t signs){
+    const __m128i one = _mm_set1_epi8(1);
+
+    __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(channels));
+    __m128i mismatch = _mm_and_si128(_mm_xor_si128(pixels, spreadBits(data)), one);
+
+    __m128i up = _mm_cmpeq_epi8(spreadBits(signs), one);
+    up = _mm_or_si128(up, _mm_cmpeq_epi8(pixels, _mm_setzero_si128()));
+    up = _mm_andnot_si128(_mm_cmpeq_epi8(pixels, _mm_set1_epi8(-1)), up);
+
+    __m128i plus = _mm_adds_epu8(pixels, mismatch), minus = _mm_subs_epu8(pixels, mismatch);
+    __m128i result = _mm_or_si128(_mm_and_si128(up, plus), _mm_andnot_si128(up, minus));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(channels), result);
+}
+
+#endif
+
+void matchContiguous(uint8_t* channels, const uint8_t* data, uint64_t count, const MatchNoise &noise, uint64_t slot){
+    uint64_t i = 0;
+
+#ifdef MATCHING_SIMD
+    for (; i + 16 <= count; i += 16)
+        match16(channels + i, data[i / 8] | data[i / 8 + 1] << 8, noiseBits(noise, slot + i));
+#endif
+
+    for (; i < count; i += 8)
+        matchScalar(channels + i, data[i / 8], noiseBits(noise, slot + i));
+}
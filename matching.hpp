@@ -0,0 +1,59 @@
+#ifndef MATCHING_HPP
+#define MATCHING_HPP
+
+#include <cstdint>
+
+/*
+    LSB matching (+-1 embedding): instead of overwriting the low 'mode' bits, a channel whose bits don't match
+    the data is moved up or down to the nearest value that carries them, so values don't pair up the way
+    replacement makes them (v and v ^ 1 getting the same counts). When both directions are as close
+    (always at 1 LSB) a noise bit picks one, 0 and 255 only move inward. Extraction is unchanged.
+
+    Noise is splitmix64 at counter = data slot / 64, so any thread can start at any slot and
+    the same seed always gives the same image.
+*/
+
+class MatchNoise{
+
+	private:
+		uint64_t seed_;
+
+	public:
+		static constexpr uint64_t seedSize = sizeof(uint64_t);
+
+		explicit MatchNoise(const uint8_t* seed);
+
+		//64 noise bits of slots [block * 64, block * 64 + 64)
+		uint64_t word(uint64_t block) const{
+			uint64_t x = seed_ + (block + 1) * 0x9e3779b97f4a7c15;
+			x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+			x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+			return x ^ (x >> 31);
+		}
+
+		bool bit(uint64_t slot) const{
+			return (word(slot / 64) >> (slot % 64)) & 1;
+		}
+};
+
+//channel value carrying 'bits' in its low 'mode' bits closest to 'value', 'up' breaks ties
+inline uint8_t matchChannel(uint8_t value, uint8_t bits, uint8_t mode, bool up){
+	int range = 1 << mode;
+	int delta = (bits - value) & (range - 1);
+
+	if(delta > range / 2 || (delta == range / 2 && !up))
+		delta -= range;
+
+	if(value + delta > 255)
+		delta -= range;
+	else if(value + delta < 0)
+		delta += range;
+
+	return value + delta;
+}
+
+//1 LSB matching of 'count' contiguous channels (a multiple of 8) with data bits taken LSB first from 'data'
+//noise bits come from 'noise' starting at 'slot', 16 channels at a time with SSE2 when available
+void matchContiguous(uint8_t* channels, const uint8_t* data, uint64_t count, const MatchNoise &noise, uint64_t slot);
+
+#endif
@@ -0,0 +1,86 @@
+#include "memory.hpp"
+
+#include <utility>
+
+#include "stb/stb_image.h"
+#include "arena.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+static void releaseArena(uint8_t* data, uint64_t){
+    Arena::release(data);
+}
+
+static void releaseStb(uint8_t* data, uint64_t){
+    stbi_image_free(data);
+}
+
+static void releaseMapped(uint8_t* data, uint64_t size){
+#if defined(__linux__)
+    munmap(data, size);
+#endif
+}
+
+Memory Memory::arena(uint64_t size){
+    return Memory(Arena::buffer(size), size, releaseArena);
+}
+
+Memory Memory::stb(uint8_t* data, uint64_t size){
+    return Memory(data, size, releaseStb);
+}
+
+Memory Memory::mapped(void* data, uint64_t size){
+    return Memory(static_cast<uint8_t*>(data), size, releaseMapped);
+}
+
+//constructors and destructor
+
+Memory::Memory(uint8_t* data, uint64_t size, Deleter deleter) : data_(data), size_(size), deleter_(deleter){
+}
+
+Memory::~Memory(){
+    reset();
+}
+
+Memory::Memory(Memory&& other) noexcept : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)), deleter_(std::exchange(other.deleter_, nullptr)){
+}
+
+Memory& Memory::operator=(Memory&& other) noexcept{
+    if(this != &other){
+        reset();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        deleter_ = std::exchange(other.deleter_, nullptr);
+    }
+
+    return *this;
+}
+
+void Memory::reset(){
+    if(data_ != nullptr && deleter_ != nullptr)
+        deleter_(data_, size_);
+
+    data_ = nullptr;
+    size_ = 0;
+    deleter_ = nullptr;
+}
+
+//getters
+
+uint8_t* Memory::data() const{
+    return data_;
+}
+
+uint64_t Memory::size() const{
+    return size_;
+}
+
+ByteSpan Memory::bytes() const{
+    return {data_, size_};
+}
+
+Memory::operator bool() const{
+    return data_ != nullptr;
+}
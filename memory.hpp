@@ -0,0 +1,61 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <cstdint>
+
+//non-owning view of bytes, what std::span<uint8_t> is in C++20
+struct ByteSpan{
+	uint8_t *data = nullptr;
+	uint64_t size = 0;
+
+	uint8_t* begin() const { return data; }
+	uint8_t* end() const { return data + size; }
+	uint8_t& operator[](uint64_t i) const { return data[i]; }
+
+	ByteSpan subspan(uint64_t offset, uint64_t count) const { return {data + offset, count}; }
+};
+
+/*
+    Owned buffer, move only, so carrier and file bytes can be handed from one stage or thread to
+    another without copies. The deleter matches whoever allocated the memory:
+        stb:   pixels from stbi_load, freed with stbi_image_free
+        arena: Arena::allocate/buffer, freed with Arena::release
+        mmap:  mapped pages, unmapped with their size
+*/
+
+class Memory{
+
+	public:
+		using Deleter = void (*)(uint8_t* data, uint64_t size);
+
+	private:
+		uint8_t *data_ = nullptr;
+		uint64_t size_ = 0;
+		Deleter deleter_ = nullptr;
+
+	public:
+		static Memory arena(uint64_t size); //throws when out of memory
+		static Memory stb(uint8_t* data, uint64_t size);
+		static Memory mapped(void* data, uint64_t size);
+
+	//constructors and destructor
+		Memory() = default;
+		Memory(uint8_t* data, uint64_t size, Deleter deleter);
+		~Memory();
+
+		Memory(Memory&& other) noexcept;
+		Memory& operator=(Memory&& other) noexcept;
+
+		Memory(const Memory&) = delete;
+		Memory& operator=(const Memory&) = delete;
+
+		void reset();
+
+	//getters
+		uint8_t* data() const;
+		uint64_t size() const;
+		ByteSpan bytes() const;
+		explicit operator bool() const;
+};
+
+#endif
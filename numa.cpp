@@ -0,0 +1,129 @@
+#include "numa.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+Numa numaMode = Numa::off;
+
+struct Node{
+    unsigned int id;
+    std::vector<unsigned int> cpus;
+};
+
+//cpulist format: "0-3,8-11"
+static std::vector<unsigned int> parseCpuList(const std::string &list){
+    std::vector<unsigned int> cpus;
+    std::stringstream stream(list);
+    std::string range;
+
+    while (std::getline(stream, range, ',')){
+        size_t dash = range.find('-');
+
+        try{
+            unsigned int first = std::stoul(range.substr(0, dash));
+            unsigned int last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+
+            for (unsigned int cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        }
+        catch(...){
+            break;
+        }
+    }
+
+    return cpus;
+}
+
+//read once, nodes without cpus (memory only) are left out
+static const std::vector<Node>& topology(){
+    static const std::vector<Node> nodes = []{
+        std::vector<Node> nodes;
+
+#if defined(__linux__)
+        for (unsigned int id = 0; id < 1024; id++){
+            std::ifstream fin("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            if(!fin)
+                continue;
+
+            std::string list;
+            std::getline(fin, list);
+
+            std::vector<unsigned int> cpus = parseCpuList(list);
+            if(!cpus.empty())
+                nodes.push_back({id, cpus});
+        }
+#endif
+
+        return nodes;
+    }();
+
+    return nodes;
+}
+
+unsigned int numaNodes(){
+    return topology().empty() ? 1 : topology().size();
+}
+
+void pinPart(unsigned int part, unsigned int parts){
+#if defined(__linux__)
+    const std::vector<Node> &nodes = topology();
+    if(nodes.size() < 2 || parts == 0)
+        return;
+
+    const Node &node = nodes[(uint64_t)part * nodes.size() / parts];
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned int cpu : node.cpus)
+        if(cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+
+    sched_setaffinity(0, sizeof(set), &set); //placement is only a hint, failures are ignored
+#endif
+}
+
+PartPin::PartPin(unsigned int part, unsigned int parts){
+#if defined(__linux__)
+    static_assert(sizeof(cpu_set_t) <= sizeof(saved_), "cpu_set_t doesn't fit");
+
+    if(numaNodes() < 2)
+        return;
+
+    pinned_ = sched_getaffinity(0, sizeof(cpu_set_t), reinterpret_cast<cpu_set_t*>(saved_)) == 0;
+    pinPart(part, parts);
+#endif
+}
+
+PartPin::~PartPin(){
+#if defined(__linux__)
+    if(pinned_)
+        sched_setaffinity(0, sizeof(cpu_set_t), reinterpret_cast<cpu_set_t*>(saved_));
+#endif
+}
+
+bool interleavePages(void* data, uint64_t size){
+#if defined(__linux__) && defined(SYS_mbind)
+    const std::vector<Node> &nodes = topology();
+    if(nodes.size() < 2)
+        return false;
+
+    constexpr int interleave = 3; //MPOL_INTERLEAVE from linux/mempolicy.h
+    constexpr unsigned int bits = 8 * sizeof(unsigned long);
+
+    std::vector<unsigned long> mask(nodes.back().id / bits + 1, 0);
+    for (const Node &node : nodes)
+        mask[node.id / bits] |= 1ul << (node.id % bits);
+
+    return syscall(SYS_mbind, data, size, interleave, mask.data(), mask.size() * bits + 1, 0) == 0;
+#else
+    return false;
+#endif
+}
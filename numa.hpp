@@ -0,0 +1,44 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include <cstdint>
+
+/*
+    NUMA placement, the topology is read from /sys/devices/system/node (Linux only):
+        local:      runParallel pins the thread of part p to node p * nodes / parts, and large arena
+                    buffers are first touched by runParallel as well, so the pages of a part are
+                    on the node of the thread that later embeds or extracts it.
+        interleave: arena pages are spread round robin over all nodes, threads are not pinned.
+    With a single node both modes do nothing.
+*/
+
+enum class Numa{ off, local, interleave };
+
+extern Numa numaMode;
+
+//nodes that have cpus
+unsigned int numaNodes();
+
+//pins the calling thread to the cpus of the node of part 'part' out of 'parts'
+void pinPart(unsigned int part, unsigned int parts);
+
+//pinPart for a scope: the affinity the thread had is saved first and restored on destruction,
+//so a thread that goes on with other work (the main thread after runParallel) is not left on one node
+class PartPin{
+
+	private:
+		uint64_t saved_[16] = {}; //cpu_set_t
+		bool pinned_ = false;
+
+	public:
+		PartPin(unsigned int part, unsigned int parts);
+		~PartPin();
+
+		PartPin(const PartPin&) = delete;
+		PartPin& operator=(const PartPin&) = delete;
+};
+
+//page aligned range, returns false if the system refused
+bool interleavePages(void* data, uint64_t size);
+
+#endif
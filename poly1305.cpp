@@ -0,0 +1,156 @@
+#include "poly1305.hpp"
+
+#include <cstring>
+
+using uint128 = unsigned __int128;
+
+static inline uint64_t load64(const uint8_t* data){
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+        value = value << 8 | data[i];
+    return value;
+}
+
+static inline void store64(uint8_t* data, uint64_t value){
+    for (int i = 0; i < 8; i++)
+        data[i] = value >> (i * 8);
+}
+
+Poly1305::Poly1305(const uint8_t* key){
+    uint64_t t0 = load64(key), t1 = load64(key + 8);
+
+    //r is clamped as the spec requires
+    r_[0] = t0 & 0xffc0fffffff;
+    r_[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+    r_[2] = (t1 >> 24) & 0x00ffffffc0f;
+
+    h_[0] = h_[1] = h_[2] = 0;
+
+    pad_[0] = load64(key + 16);
+    pad_[1] = load64(key + 24);
+}
+
+Poly1305::~Poly1305(){
+    volatile uint8_t *bytes = reinterpret_cast<volatile uint8_t*>(this);
+    for (size_t i = 0; i < sizeof(*this); i++)
+        bytes[i] = 0;
+}
+
+//h = (h + block) * r mod 2^130 - 5 for every 16 byte block, 'hibit' is the 2^128 bit of full blocks
+void Poly1305::blocks(const uint8_t* data, uint64_t size, uint64_t hibit){
+    const uint64_t mask = 0xfffffffffff;
+    uint64_t r0 = r_[0], r1 = r_[1], r2 = r_[2];
+    uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = h_[0], h1 = h_[1], h2 = h_[2];
+
+    for (; size >= 16; size -= 16, data += 16){
+        uint64_t t0 = load64(data), t1 = load64(data + 8);
+
+        h0 += t0 & mask;
+        h1 += ((t0 >> 44) | (t1 << 20)) & mask;
+        h2 += ((t1 >> 24) & 0x3ffffffffff) | hibit;
+
+        uint128 d0 = (uint128)h0 * r0 + (uint128)h1 * s2 + (uint128)h2 * s1;
+        uint128 d1 = (uint128)h0 * r1 + (uint128)h1 * r0 + (uint128)h2 * s2;
+        uint128 d2 = (uint128)h0 * r2 + (uint128)h1 * r1 + (uint128)h2 * r0;
+
+        uint64_t carry = (uint64_t)(d0 >> 44); h0 = (uint64_t)d0 & mask;
+        d1 += carry; carry = (uint64_t)(d1 >> 44); h1 = (uint64_t)d1 & mask;
+        d2 += carry; carry = (uint64_t)(d2 >> 42); h2 = (uint64_t)d2 & 0x3ffffffffff;
+        h0 += carry * 5; carry = h0 >> 44; h0 &= mask;
+        h1 += carry;
+    }
+
+    h_[0] = h0;
+    h_[1] = h1;
+    h_[2] = h2;
+}
+
+void Poly1305::update(const uint8_t* data, uint64_t size){
+    if(buffered_ > 0){
+        uint64_t length = size < 16 - buffered_ ? size : 16 - buffered_;
+        std::memcpy(buffer_ + buffered_, data, length);
+        buffered_ += length;
+        data += length;
+        size -= length;
+
+        if(buffered_ < 16)
+            return;
+
+        blocks(buffer_, 16, 1ull << 40);
+        buffered_ = 0;
+    }
+
+    uint64_t full = size & ~(uint64_t)15;
+    blocks(data, full, 1ull << 40);
+
+    std::memcpy(buffer_, data + full, size - full);
+    buffered_ = size - full;
+}
+
+void Poly1305::finish(uint8_t* tag){
+    const uint64_t mask = 0xfffffffffff;
+
+    //last partial block is padded with a 1 byte and zeros instead of the 2^128 bit
+    if(buffered_ > 0){
+        buffer_[buffered_] = 1;
+        std::memset(buffer_ + buffered_ + 1, 0, 16 - buffered_ - 1);
+        blocks(buffer_, 16, 0);
+    }
+
+    uint64_t h0 = h_[0], h1 = h_[1], h2 = h_[2], carry;
+
+    carry = h1 >> 44; h1 &= mask;
+    h2 += carry; carry = h2 >> 42; h2 &= 0x3ffffffffff;
+    h0 += carry * 5; carry = h0 >> 44; h0 &= mask;
+    h1 += carry; carry = h1 >> 44; h1 &= mask;
+    h2 += carry; carry = h2 >> 42; h2 &= 0x3ffffffffff;
+    h0 += carry * 5; carry = h0 >> 44; h0 &= mask;
+    h1 += carry;
+
+    //h - p, selected without branches when h >= p
+    uint64_t g0 = h0 + 5; carry = g0 >> 44; g0 &= mask;
+    uint64_t g1 = h1 + carry; carry = g1 >> 44; g1 &= mask;
+    uint64_t g2 = h2 + carry - (1ull << 42);
+
+    uint64_t select = (g2 >> 63) - 1;
+    h0 = (h0 & ~select) | (g0 & select);
+    h1 = (h1 & ~select) | (g1 & select);
+    h2 = (h2 & ~select) | (g2 & select);
+
+    //h + pad mod 2^128
+    uint64_t t0 = pad_[0], t1 = pad_[1];
+
+    h0 += t0 & mask; carry = h0 >> 44; h0 &= mask;
+    h1 += (((t0 >> 44) | (t1 << 20)) & mask) + carry; carry = h1 >> 44; h1 &= mask;
+    h2 += ((t1 >> 24) & 0x3ffffffffff) + carry; h2 &= 0x3ffffffffff;
+
+    store64(tag, h0 | (h1 << 44));
+    store64(tag + 8, (h1 >> 20) | (h2 << 24));
+}
+
+void poly1305Aead(uint8_t* tag, const uint8_t* key, const uint8_t* aad, uint64_t aadSize, const uint8_t* data, uint64_t size){
+    static const uint8_t zeros[16] = {};
+
+    Poly1305 mac(key);
+
+    mac.update(aad, aadSize);
+    mac.update(zeros, (16 - aadSize % 16) % 16);
+    mac.update(data, size);
+    mac.update(zeros, (16 - size % 16) % 16);
+
+    uint8_t sizes[16];
+    store64(sizes, aadSize);
+    store64(sizes + 8, size);
+    mac.update(sizes, 16);
+
+    mac.finish(tag);
+}
+
+bool tagsEqual(const uint8_t* a, const uint8_t* b){
+    uint8_t difference = 0;
+    for (uint64_t i = 0; i < poly1305TagSize; i++)
+        difference |= a[i] ^ b[i];
+
+    return difference == 0;
+}
@@ -0,0 +1,38 @@
+#ifndef POLY1305_HPP
+#define POLY1305_HPP
+
+#include <cstdint>
+
+inline constexpr uint64_t poly1305KeySize = 32;
+inline constexpr uint64_t poly1305TagSize = 16;
+
+/*
+    Poly1305 one-time authenticator with 44-bit limbs and 128-bit products (based on poly1305-donna).
+    A key must never authenticate two different messages, callers derive a fresh key from their
+    cipher keystream for every message.
+*/
+
+class Poly1305{
+
+	private:
+		uint64_t r_[3], h_[3], pad_[2];
+		uint8_t buffer_[16];
+		uint64_t buffered_ = 0;
+
+		void blocks(const uint8_t* data, uint64_t size, uint64_t hibit);
+
+	public:
+		explicit Poly1305(const uint8_t* key);
+		~Poly1305(); //key and state are zeroized
+
+		void update(const uint8_t* data, uint64_t size);
+		void finish(uint8_t* tag);
+};
+
+//AEAD construction of RFC 8439: aad, padding, ciphertext, padding, then both sizes as 64-bit little endian
+void poly1305Aead(uint8_t* tag, const uint8_t* key, const uint8_t* aad, uint64_t aadSize, const uint8_t* data, uint64_t size);
+
+//constant time comparison of two tags
+bool tagsEqual(const uint8_t* a, const uint8_t* b);
+
+#endif
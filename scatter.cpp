@@ -0,0 +1,86 @@
+#include "scatter.hpp"
+
+#include "stego.hpp"
+
+//splitmix64 finalizer
+static inline uint64_t mix(uint64_t x){
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return x;
+}
+
+Scatter::Prp::Prp(uint64_t size) : size(size){
+    int bits = 0;
+    while (bits < 64 && (size - 1) >> bits)
+        bits++;
+
+    halfBits = bits < 2 ? 1 : (bits + 1) / 2;
+    mask = (1ull << halfBits) - 1;
+}
+
+uint64_t Scatter::Prp::permute(uint64_t x, uint64_t tweak, const uint64_t* keys) const{
+    if(size <= 1)
+        return 0;
+
+    //x < size and the network is a permutation of [0, 2^(2 * halfBits)), so walking its cycle ends below size
+    do{
+        uint64_t left = x >> halfBits, right = x & mask;
+
+        for (int round = 0; round < rounds; round++){
+            uint64_t next = left ^ (mix(keys[round] ^ right ^ (tweak << 32)) & mask);
+            left = right;
+            right = next;
+        }
+
+        x = left << halfBits | right;
+    } while (x >= size);
+
+    return x;
+}
+
+Scatter::Scatter(const uint8_t* seed, uint64_t first, uint64_t slots, uint64_t tileSize, uint8_t channels)
+    : first_(first), slots_(slots), tileSize_(tileSize < slots ? tileSize : 0), channels_(channels){
+
+    for (int round = 0; round < rounds; round++){
+        keys_[round] = 0;
+        for (int i = 0; i < 8; i++)
+            keys_[round] |= uint64_t(seed[round * 8 + i]) << (i * 8);
+    }
+
+    if(tileSize_ == 0){
+        whole_ = Prp(slots_);
+    }
+    else{
+        whole_ = Prp(slots_ / tileSize_);
+        tile_ = Prp(tileSize_);
+        last_ = Prp(slots_ % tileSize_);
+    }
+}
+
+Scatter::~Scatter(){
+    volatile uint64_t *keys = keys_;
+    for (int round = 0; round < rounds; round++)
+        keys[round] = 0;
+}
+
+uint64_t Scatter::channel(uint64_t slot) const{
+    if(tileSize_ == 0)
+        return whole_.permute(slot, 0, keys_);
+
+    uint64_t tile = slot / tileSize_, offset = slot % tileSize_;
+
+    //tweak 0 is the tile order, tile t is permuted with tweak t + 1
+    if(tile < whole_.size){
+        uint64_t placed = whole_.permute(tile, 0, keys_);
+        return placed * tileSize_ + tile_.permute(offset, placed + 1, keys_);
+    }
+
+    return tile * tileSize_ + last_.permute(offset, tile + 1, keys_);
+}
+
+uint64_t Scatter::position(uint64_t slot) const{
+    return skipChannels(first_, channel(slot), channels_);
+}
@@ -0,0 +1,60 @@
+#ifndef SCATTER_HPP
+#define SCATTER_HPP
+
+#include <cstdint>
+
+/*
+    Keyed pseudorandom layout of the data channels, instead of filling them in order from the first one.
+    Data slot k (the k-th group of 'mode' bits) goes to usable channel prp(k) after the header, where prp
+    is a 4 round Feistel network over the next even power of 2 with cycle walking down to the slot count.
+    Every slot is computed on its own in O(1) (less than 4 walks on average), so any thread can embed
+    or extract any part of the data.
+
+    Tiled: slots are split in tiles of 'tileSize' channels (about an L2 cache of pixels), the full tiles are
+    permuted among themselves and every tile is permuted inside, so consecutive data stays within one tile.
+    The last partial tile stays last.
+*/
+
+class Scatter{
+
+	public:
+		static constexpr int rounds = 4;
+		static constexpr uint64_t seedSize = rounds * sizeof(uint64_t);
+
+	private:
+		struct Prp{
+			uint64_t size = 0;
+			int halfBits = 0;
+			uint64_t mask = 0;
+
+			Prp() = default;
+			explicit Prp(uint64_t size);
+
+			uint64_t permute(uint64_t x, uint64_t tweak, const uint64_t* keys) const;
+		};
+
+		uint64_t keys_[rounds];
+
+		uint64_t first_;
+		uint64_t slots_;
+		uint64_t tileSize_;
+		uint8_t channels_;
+
+		Prp whole_;  //all slots, or the full tiles when tiled
+		Prp tile_;   //inside a full tile
+		Prp last_;   //inside the last partial tile
+
+	public:
+		//'first' is the image index of the first data channel, 'slots' the usable channels from there
+		//'tileSize' 0 permutes all slots at once
+		Scatter(const uint8_t* seed, uint64_t first, uint64_t slots, uint64_t tileSize, uint8_t channels);
+		~Scatter(); //round keys are zeroized
+
+		//usable channel of data slot 'slot', counted from the first data channel
+		uint64_t channel(uint64_t slot) const;
+
+		//image index of data slot 'slot'
+		uint64_t position(uint64_t slot) const;
+};
+
+#endif
@@ -0,0 +1,226 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct Record{
+    const char* name;
+    unsigned int worker;
+    uint64_t start;
+    uint64_t end;
+    uint64_t bytes;
+};
+
+struct Buffer{
+    unsigned int worker = 0;
+    std::vector<Record> records;
+};
+
+//buffers are owned here so they outlive the worker threads that filled them
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<Buffer>> buffers;
+
+//the lock is only taken once per thread, when it records its first span
+static Buffer& threadBuffer(){
+    thread_local Buffer *buffer = nullptr;
+
+    if(buffer == nullptr){
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::make_unique<Buffer>());
+        buffer = buffers.back().get();
+        buffer->records.reserve(1024); //avoids reallocating while the first chunks are timed
+    }
+
+    return *buffer;
+}
+
+//spans with the same name added up
+struct Row{
+    std::string name;
+    uint64_t first = UINT64_MAX;
+    uint64_t calls = 0;
+    uint64_t total = 0;
+    uint64_t bytes = 0;
+    std::map<unsigned int, uint64_t> workers; //total time of every worker
+};
+
+static std::vector<Row> aggregate(uint64_t &wall){
+    std::lock_guard<std::mutex> lock(buffersMutex);
+
+    std::map<std::string, Row> rows;
+    uint64_t first = UINT64_MAX, last = 0;
+
+    for (const auto &buffer : buffers){
+        for (const Record &record : buffer->records){
+            Row &row = rows[record.name];
+            row.name = record.name;
+            row.first = std::min(row.first, record.start);
+            row.calls++;
+            row.total += record.end - record.start;
+            row.bytes += record.bytes;
+            row.workers[record.worker] += record.end - record.start;
+
+            first = std::min(first, record.start);
+            last = std::max(last, record.end);
+        }
+    }
+
+    std::vector<Row> ordered;
+    for (auto &entry : rows)
+        ordered.push_back(entry.second);
+
+    //stages are listed in the order they started
+    std::sort(ordered.begin(), ordered.end(), [](const Row &a, const Row &b) { return a.first < b.first; });
+
+    wall = last > first ? last - first : 0;
+    return ordered;
+}
+
+static uint64_t slowest(const Row &row){
+    uint64_t slowest = 0;
+    for (const auto &worker : row.workers)
+        slowest = std::max(slowest, worker.second);
+
+    return slowest;
+}
+
+static double milliseconds(uint64_t nanoseconds){
+    return nanoseconds / 1e6;
+}
+
+//throughput of one thread, bytes over the time spent in the stage
+static double megabytesPerSecond(const Row &row){
+    return row.total == 0 ? 0 : (row.bytes / 1e6) / (row.total / 1e9);
+}
+
+bool Stats::enabled = false;
+
+uint64_t Stats::now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Stats::setWorker(unsigned int worker){
+    if(enabled)
+        threadBuffer().worker = worker;
+}
+
+void Stats::record(const char* name, uint64_t start, uint64_t end, uint64_t bytes){
+    Buffer &buffer = threadBuffer();
+    buffer.records.push_back({name, buffer.worker, start, end, bytes});
+}
+
+void Stats::print(std::ostream &out){
+    uint64_t wall = 0;
+    std::vector<Row> rows = aggregate(wall);
+
+    std::ios flags(nullptr);
+    flags.copyfmt(out);
+
+    out << '\n' << std::left << std::setw(12) << "Stage" << std::right
+        << std::setw(8) << "Calls" << std::setw(9) << "Threads" << std::setw(12) << "Total ms"
+        << std::setw(12) << "Slowest ms" << std::setw(14) << "Bytes" << std::setw(11) << "MB/s" << '\n';
+
+    out << std::fixed << std::setprecision(3);
+
+    for (const Row &row : rows){
+        out << std::left << std::setw(12) << row.name << std::right
+            << std::setw(8) << row.calls << std::setw(9) << row.workers.size()
+            << std::setw(12) << milliseconds(row.total) << std::setw(12) << milliseconds(slowest(row))
+            << std::setw(14) << row.bytes;
+
+        if(row.bytes > 0)
+            out << std::setw(11) << std::setprecision(1) << megabytesPerSecond(row) << std::setprecision(3);
+        else
+            out << std::setw(11) << '-';
+
+        out << '\n';
+    }
+
+    out << "Wall time: " << milliseconds(wall) << " ms\n";
+    out.copyfmt(flags);
+}
+
+void Stats::printJson(std::ostream &out){
+    uint64_t wall = 0;
+    std::vector<Row> rows = aggregate(wall);
+
+    std::ios flags(nullptr);
+    flags.copyfmt(out);
+
+    out << std::fixed << std::setprecision(6);
+    out << "{\n  \"wall_ms\": " << milliseconds(wall) << ",\n  \"stages\": [";
+
+    for (size_t i = 0; i < rows.size(); i++){
+        const Row &row = rows[i];
+
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"name\": \"" << row.name << "\", \"calls\": " << row.calls << ", \"threads\": " << row.workers.size()
+            << ", \"total_ms\": " << milliseconds(row.total) << ", \"slowest_thread_ms\": " << milliseconds(slowest(row))
+            << ", \"bytes\": " << row.bytes << ", \"mb_per_s\": " << megabytesPerSecond(row) << '}';
+    }
+
+    out << "\n  ]\n}\n";
+    out.copyfmt(flags);
+}
+
+void Stats::printTrace(std::ostream &out){
+    std::lock_guard<std::mutex> lock(buffersMutex);
+
+    uint64_t first = UINT64_MAX;
+    std::map<unsigned int, bool> workers;
+
+    for (const auto &buffer : buffers){
+        for (const Record &record : buffer->records){
+            first = std::min(first, record.start);
+            workers[record.worker] = true;
+        }
+    }
+
+    std::ios flags(nullptr);
+    flags.copyfmt(out);
+
+    //timestamps are in microseconds from the first span
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+    bool comma = false;
+    for (const auto &worker : workers){
+        out << (comma ? ",\n" : "\n")
+            << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << worker.first
+            << ", \"args\": {\"name\": \"" << (worker.first == 0 ? std::string("main") : "worker " + std::to_string(worker.first)) << "\"}}";
+        comma = true;
+    }
+
+    for (const auto &buffer : buffers){
+        for (const Record &record : buffer->records){
+            out << (comma ? ",\n" : "\n")
+                << "  {\"name\": \"" << record.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << record.worker
+                << ", \"ts\": " << (record.start - first) / 1e3 << ", \"dur\": " << (record.end - record.start) / 1e3
+                << ", \"args\": {\"bytes\": " << record.bytes << "}}";
+            comma = true;
+        }
+    }
+
+    out << "\n]}\n";
+    out.copyfmt(flags);
+}
+
+Span::Span(const char* name, uint64_t bytes) : name_(name), bytes_(bytes){
+    if(Stats::enabled)
+        start_ = Stats::now();
+}
+
+Span::~Span(){
+    if(Stats::enabled && start_ != 0)
+        Stats::record(name_, start_, Stats::now(), bytes_);
+}
+
+void Span::bytes(uint64_t bytes){
+    bytes_ = bytes;
+}
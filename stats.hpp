@@ -0,0 +1,54 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <cstdint>
+#include <ostream>
+
+/*
+    Timing instrumentation:
+        Span measures a stage with the monotonic clock from its construction to its destruction.
+        Every thread appends its spans to its own buffer, buffers are only merged when printing,
+        so recording from worker threads doesn't need any locking.
+        When stats are disabled a span only checks a flag.
+*/
+
+class Stats{
+
+	public:
+		static bool enabled;
+
+		//monotonic time in nanoseconds
+		static uint64_t now();
+
+		//worker index of the calling thread (0 is the main thread), spans are grouped by it
+		static void setWorker(unsigned int worker);
+
+		static void record(const char* name, uint64_t start, uint64_t end, uint64_t bytes);
+
+		//table of stage times, bytes processed and throughput
+		static void print(std::ostream &out);
+		static void printJson(std::ostream &out);
+
+		//every span as a Chrome/Perfetto trace event, one track per worker
+		static void printTrace(std::ostream &out);
+};
+
+class Span{
+
+	private:
+		const char* name_;
+		uint64_t bytes_;
+		uint64_t start_ = 0;
+
+	public:
+		Span(const char* name, uint64_t bytes = 0);
+		~Span();
+
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+
+		//bytes processed, for stages that only know it at the end
+		void bytes(uint64_t bytes);
+};
+
+#endif
@@ -0,0 +1,1655 @@
+#include "stego.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <optional>
+
+#include "crc32c.hpp"
+#include "compress.hpp"
+#include "poly1305.hpp"
+#include "matching.hpp"
+#include "coding.hpp"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #include <immintrin.h>
+    #define STEGO_SIMD 1
+#endif
+
+std::string headerMarker = "MSGSTART"; //v1 marker, new images are written with the v2 header from header.hpp
+
+unsigned int numThreads = std::thread::hardware_concurrency(); //can be changed according to the system
+thread_local ThreadShare threadShare;
+
+uint32_t crcChunkSize = 1 << 16; //bytes covered by each CRC in the v2 header, must be a multiple of the cipher block size (64 bytes for ChaCha20)
+
+uint32_t compressBlockSize = 1 << 16; //file data is compressed in independent blocks of this size
+
+uint32_t scatterTileSize = 1 << 18; //usable channels per tile of the tiled scatter layout, about an L2 cache of pixels
+
+/*
+    Header v1 Structure (only read, see header.hpp for v2):
+        - Mode (1 bit): 
+            Indicates the LSB mode for reading and storing message:
+            0 -> 1 LSB per pixel channel
+            1 -> 2 LSBs per pixel channel
+        - "MSGSTART" Marker (8 bytes / 64 bits): 
+            A fixed ASCII marker ("MSGSTART") that confirms the presence of a data in the image.
+        - Data Size (8 bytes / 64 bits):
+            Specifies the size of the data in bytes.
+
+    // total header size = 1 + 64 + 64 = 129bits
+
+    Hidden File Data:
+        - Variable Length Data: The actual file data follows the header and is encoded based on the LSB mode.
+        - Variable Length Extension: stored in reverse separating by null character. Example: [data][data]...[data]['\0'][t][x][t][.]
+
+    Encrypton:
+        header marker + data size = 128 bits are encrypted using AES in ECB mode with 128 bit Counter(Initialization Vector) as key.
+
+        and the variable size file data is encrypted using AES in CTR mode with Key and Counter.
+
+*/
+
+//moves imgIterator forward by 'count' usable channels (skipping alpha channels) in O(1) time
+uint64_t skipChannels(uint64_t imgIterator, uint64_t count, uint8_t channels) {
+    if(channels % 2 != 0)
+        return imgIterator + count;
+
+    uint64_t usable = channels - 1;
+    uint64_t channel = (imgIterator / channels) * usable + std::min<uint64_t>(imgIterator % channels, usable) + count;
+
+    return (channel / usable) * channels + channel % usable;
+}
+
+//usable channels before image index imgIterator
+uint64_t usableBefore(uint64_t imgIterator, uint8_t channels) {
+    if(channels % 2 != 0)
+        return imgIterator;
+
+    return (imgIterator / channels) * (channels - 1) + std::min<uint64_t>(imgIterator % channels, channels - 1);
+}
+
+//the rectangle of a region of interest, its rows start at whole pixels
+Region dataRegion(Image &inputImage, const Header &header, uint64_t dataIterator) {
+    uint8_t channels = inputImage.channels();
+    if(!(header.flags & Header::roiFlag))
+        return {dataIterator, UINT64_MAX, 0, channels};
+
+    uint64_t usable = channels % 2 == 0 ? channels - 1 : channels;
+    uint64_t stride = (uint64_t)inputImage.width() * channels;
+
+    return {header.roiY * stride + (uint64_t)header.roiX * channels, header.roiWidth * usable, stride, channels};
+}
+
+//channels holding the first 'bytes' data bytes, exact at chunk starts as chunks begin at a whole byte group
+uint64_t dataSlots(uint64_t bytes, uint8_t mode) {
+    return (bytes * 8 + mode - 1) / mode;
+}
+
+//channels of one coded segment
+static uint64_t segmentSlots(const Header &header, uint64_t bytes) {
+    return header.coding == Header::hamming ? hammingSlots(bytes, header.codingParam) : stcSlots(bytes, header.codingParam);
+}
+
+//same for the data of a header, coded data takes whole segments
+uint64_t dataSlots(const Header &header, uint64_t bytes) {
+    if(!(header.flags & Header::codingFlag))
+        return dataSlots(bytes, header.mode);
+
+    return bytes / codingSegment * segmentSlots(header, codingSegment) + segmentSlots(header, bytes % codingSegment);
+}
+
+//chunk size for a mode, 3 LSBs pack 3 bytes in 8 channels so chunks must be a multiple of 3 bytes for threads not to share a channel
+uint32_t modeChunkSize(uint8_t mode) {
+    return mode == 3 ? crcChunkSize - crcChunkSize % (3 * chachaBlockSize) : crcChunkSize;
+}
+
+//checks if the data and its v2 header fit in the image with the header mode, the header starting at channel 'start'
+//a region of interest has to be inside the image, after the header, and hold the data
+bool fits(Image &inputImage, const Header &header, uint64_t start) {
+    if(header.flags & Header::roiFlag){
+        bool inside = (uint64_t)header.roiX + header.roiWidth <= (uint64_t)inputImage.width() && (uint64_t)header.roiY + header.roiHeight <= (uint64_t)inputImage.height();
+        Region region = dataRegion(inputImage, header, 0);
+
+        return inside && skipChannels(start, (uint64_t)header.size() * 8, inputImage.channels()) <= region.start && dataSlots(header, header.dataSize) <= region.rowSlots * header.roiHeight;
+    }
+
+    uint64_t available = inputImage.size_no_alpha() - usableBefore(start, inputImage.channels()); //first channel holds the legacy mode bit
+    uint64_t needed = (uint64_t)header.size() * 8 + dataSlots(header, header.dataSize);
+
+    return needed <= available;
+}
+
+//maximum data in bytes that fits in the image with the header mode
+uint64_t availableBytes(Image &inputImage, Header header, uint64_t start) {
+    uint64_t low = 0, high = header.mode * inputImage.size_no_alpha() / 8;
+
+    while (low < high) {
+        header.dataSize = (low + high + 1) / 2;
+        if(fits(inputImage, header, start))
+            low = header.dataSize;
+        else
+            high = header.dataSize - 1;
+    }
+
+    return low;
+}
+
+//sets the smallest mode that fits the data and its chunk size, throws if it does not fit at all
+//coded data is always at 1 LSB and gets the most efficient code that fits instead
+void selectMode(Image &inputImage, Header &header, uint64_t start) {
+    if(header.flags & Header::codingFlag){
+        header.mode = 1;
+        header.chunkSize = crcChunkSize;
+
+        bool hamming = header.coding == Header::hamming;
+        uint8_t low = hamming ? hammingMinBits : stcMinWidth;
+
+        for (header.codingParam = hamming ? hammingMaxBits : stcMaxWidth; header.codingParam > low; header.codingParam--)
+            if(fits(inputImage, header, start))
+                return;
+
+        if(fits(inputImage, header, start))
+            return;
+
+        throw std::runtime_error("File is too large to fit with " + std::string(hamming ? "Hamming" : "STC") + " coding.\nThe Image can fit " + std::to_string(availableBytes(inputImage, header, start)) + " bytes.");
+    }
+
+    for (header.mode = 1; header.mode <= Header::maxMode; header.mode++){
+        header.chunkSize = modeChunkSize(header.mode);
+        if(fits(inputImage, header, start))
+            return;
+    }
+
+    header.mode = Header::maxMode;
+    header.chunkSize = modeChunkSize(header.mode);
+    throw std::runtime_error("File is too large to fit.\nThe Image can fit " + std::to_string(availableBytes(inputImage, header, start)) + " bytes.");
+}
+
+//throws if 'dataSize' bytes of uncompressed data don't fit in the image
+void checkCapacity(Image &inputImage, uint64_t dataSize) {
+    Span span("capacity");
+
+    Header header;
+    header.dataSize = dataSize;
+
+    selectMode(inputImage, header);
+}
+
+//compresses file data in independent blocks using threads, fills the compression section of the header
+std::vector<uint8_t> compressData(const uint8_t* fileData, uint64_t fileSize, Header &header) {
+    header.flags |= Header::compressedFlag;
+    header.compressBlockSize = compressBlockSize;
+    header.originalSize = fileSize;
+    header.compressedSizes.resize(header.blockCount());
+
+    uint64_t bound = compressBound(compressBlockSize);
+    std::vector<uint8_t> compressed(header.blockCount() * bound);
+
+    runParallel(header.blockCount(), 1, [&](uint64_t firstBlock, uint64_t count) {
+        for (uint64_t block = firstBlock; block < firstBlock + count; block++){
+            uint64_t offset = block * compressBlockSize;
+            uint64_t length = std::min<uint64_t>(compressBlockSize, fileSize - offset);
+            uint8_t *blockData = compressed.data() + block * bound;
+
+            Span span("compress", length);
+            uint64_t size = compressBlock(fileData + offset, length, blockData);
+
+            //incompressible blocks are stored as they are
+            if(size >= length){
+                std::copy(fileData + offset, fileData + offset + length, blockData);
+                size = length | Header::rawBlock;
+            }
+
+            header.compressedSizes[block] = size;
+        }
+    });
+
+    //packing blocks one after another, a block never moves past its own slot so it's done in place
+    uint64_t size = 0;
+    for (uint64_t block = 0; block < header.blockCount(); block++){
+        uint64_t length = header.compressedSizes[block] & ~Header::rawBlock;
+        std::copy(compressed.begin() + block * bound, compressed.begin() + block * bound + length, compressed.begin() + size);
+        size += length;
+    }
+
+    compressed.resize(size);
+    header.dataSize = size;
+
+    return compressed;
+}
+
+//decompresses 'count' blocks from firstBlock using threads, 'stored' starts with the first block
+void decompressData(const Header &header, uint64_t firstBlock, uint64_t count, const uint8_t* stored, uint8_t* fileData) {
+    std::vector<uint64_t> offsets(count + 1, 0);
+    for (uint64_t i = 0; i < count; i++)
+        offsets[i + 1] = offsets[i] + (header.compressedSizes[firstBlock + i] & ~Header::rawBlock);
+
+    std::vector<uint8_t> corrupted(count, 0);
+
+    runParallel(count, 1, [&](uint64_t first, uint64_t partCount) {
+        for (uint64_t i = first; i < first + partCount; i++){
+            uint32_t size = header.compressedSizes[firstBlock + i];
+            uint64_t length = std::min<uint64_t>(header.compressBlockSize, header.originalSize - (firstBlock + i) * header.compressBlockSize);
+            uint8_t *blockData = fileData + i * header.compressBlockSize;
+
+            Span span("decompress", length);
+            if(size & Header::rawBlock){
+                if((size & ~Header::rawBlock) == length)
+                    std::copy(stored + offsets[i], stored + offsets[i] + length, blockData);
+                else
+                    corrupted[i] = 1;
+            }
+            else if(!decompressBlock(stored + offsets[i], size, blockData, length)){
+                corrupted[i] = 1;
+            }
+        }
+    });
+
+    if(std::find(corrupted.begin(), corrupted.end(), 1) != corrupted.end())
+        throw std::runtime_error("Corrupted compressed data. Cannot retrieve the file.");
+}
+
+//data bits are packed LSB first, 'mode' bits per channel, bytes are packed in groups that fill whole channels
+//(1 byte at 1, 2 and 4 bits, 3 bytes = 8 channels at 3 bits), a partial last group uses only the channels it needs
+//put(bits) stores the bits of the next channel
+template<uint8_t Mode, typename Put>
+static inline void packBits(const uint8_t* fileData, uint64_t size, Put put) {
+    constexpr uint8_t mask = (1 << Mode) - 1;
+    constexpr uint64_t group = Mode == 3 ? 3 : 1;
+
+    auto packGroup = [&](const uint8_t* bytes, uint64_t count) {
+        uint32_t bits = 0;
+        for (uint64_t i = 0; i < count; i++)
+            bits |= (uint32_t)bytes[i] << (i * 8);
+
+        for (uint64_t bit = 0; bit < count * 8; bit += Mode)
+            put((bits >> bit) & mask);
+    };
+
+    uint64_t full = size - size % group;
+    for (uint64_t fileIterator = 0; fileIterator < full; fileIterator += group)
+        packGroup(fileData + fileIterator, group);
+
+    if(full < size)
+        packGroup(fileData + full, size - full);
+}
+
+template<uint8_t Mode, typename Channel>
+static inline void unpackBits(uint8_t* fileData, uint64_t size, Channel channel) {
+    constexpr uint8_t mask = (1 << Mode) - 1;
+    constexpr uint64_t group = Mode == 3 ? 3 : 1;
+
+    auto unpackGroup = [&](uint8_t* bytes, uint64_t count) {
+        uint32_t bits = 0;
+        for (uint64_t bit = 0; bit < count * 8; bit += Mode)
+            bits |= (uint32_t)(channel() & mask) << bit;
+
+        for (uint64_t i = 0; i < count; i++)
+            bytes[i] = bits >> (i * 8);
+    };
+
+    uint64_t full = size - size % group;
+    for (uint64_t fileIterator = 0; fileIterator < full; fileIterator += group)
+        unpackGroup(fileData + fileIterator, group);
+
+    if(full < size)
+        unpackGroup(fileData + full, size - full);
+}
+
+//calls work with the mode as a compile time constant, so every density gets its own unrolled kernel
+template<typename Work>
+static inline auto withMode(uint8_t mode, Work work) {
+    switch (mode){
+        case 1: return work(std::integral_constant<uint8_t, 1>{});
+        case 2: return work(std::integral_constant<uint8_t, 2>{});
+        case 3: return work(std::integral_constant<uint8_t, 3>{});
+        case 4: return work(std::integral_constant<uint8_t, 4>{});
+    }
+
+    throw std::runtime_error("Unsupported LSB mode " + std::to_string(mode) + '.');
+}
+
+//calls work(next) where next() returns the next usable channel from imgIterator, skipping alpha channels
+//the channel within the pixel is tracked instead of a division per channel, images without alpha just walk the data
+template<typename Work>
+static inline void walkChannels(uint64_t &imgIterator, uint8_t channels, Work work) {
+    if(channels % 2 != 0){
+        work([&]() { return imgIterator++; });
+        return;
+    }
+
+    uint8_t pixelChannel = imgIterator % channels;
+    work([&]() {
+        if(pixelChannel == channels - 1){
+            imgIterator++;
+            pixelChannel = 0;
+        }
+
+        pixelChannel++;
+        return imgIterator++;
+    });
+}
+
+//calls work(next) where next() returns the next usable channel of the region from 'slot', the end of a row goes on at the next row
+template<typename Work>
+static inline void walkRegion(const Region &region, uint64_t slot, Work work) {
+    uint64_t rowStart = region.start + slot / region.rowSlots * region.stride;
+    uint64_t column = slot % region.rowSlots;
+    uint64_t imgIterator = skipChannels(rowStart, column, region.channels);
+
+    uint8_t channels = region.channels;
+    uint8_t pixelChannel = imgIterator % channels;
+
+    work([&]() {
+        if(column == region.rowSlots){
+            rowStart += region.stride;
+            imgIterator = rowStart;
+            column = 0;
+            pixelChannel = 0;
+        }
+        else if(channels % 2 == 0 && pixelChannel == channels - 1){
+            imgIterator++;
+            pixelChannel = 0;
+        }
+
+        column++;
+        pixelChannel++;
+        return imgIterator++;
+    });
+}
+
+//inserts file inside the image in chunks, returns the iterator after the last written channel
+uint64_t insertChunk(uint8_t* imgData, uint64_t imgIterator, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode, uint8_t channels) {
+    withMode(mode, [&](auto Mode) {
+        walkChannels(imgIterator, channels, [&](auto next) {
+            packBits<Mode>(fileData, chunkSize, [&](uint8_t bits) {
+                uint8_t &value = imgData[next()];
+                value = (value & ~((1 << Mode) - 1)) | bits;
+            });
+        });
+    });
+
+    return imgIterator;
+}
+
+//retreives file inside the image in chunks, returns the iterator after the last read channel
+uint64_t retrieveChunk(const uint8_t* imgData, uint64_t imgIterator, uint8_t* fileData, uint64_t chunkSize, uint8_t mode, uint8_t channels) {
+    withMode(mode, [&](auto Mode) {
+        walkChannels(imgIterator, channels, [&](auto next) {
+            unpackBits<Mode>(fileData, chunkSize, [&]() { return imgData[next()]; });
+        });
+    });
+
+    return imgIterator;
+}
+
+//scatter layout: data slot k is written to scatter.position(k), returns the slot after the last written one
+uint64_t insertScattered(uint8_t* imgData, const Scatter &scatter, uint64_t slot, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode) {
+    withMode(mode, [&](auto Mode) {
+        packBits<Mode>(fileData, chunkSize, [&](uint8_t bits) {
+            uint8_t &value = imgData[scatter.position(slot++)];
+            value = (value & ~((1 << Mode) - 1)) | bits;
+        });
+    });
+
+    return slot;
+}
+
+uint64_t retrieveScattered(const uint8_t* imgData, const Scatter &scatter, uint64_t slot, uint8_t* fileData, uint64_t chunkSize, uint8_t mode) {
+    withMode(mode, [&](auto Mode) {
+        unpackBits<Mode>(fileData, chunkSize, [&]() { return imgData[scatter.position(slot++)]; });
+    });
+
+    return slot;
+}
+
+//adaptive layout: data slot k is written to selected channel k, returns the slot after the last written one
+uint64_t insertSelected(uint8_t* imgData, const Selection &selection, uint64_t slot, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode) {
+    Selection::Cursor cursor(selection, slot);
+
+    withMode(mode, [&](auto Mode) {
+        packBits<Mode>(fileData, chunkSize, [&](uint8_t bits) {
+            uint8_t &value = imgData[cursor.next()];
+            value = (value & ~((1 << Mode) - 1)) | bits;
+        });
+    });
+
+    return slot + dataSlots(chunkSize, mode);
+}
+
+uint64_t retrieveSelected(const uint8_t* imgData, const Selection &selection, uint64_t slot, uint8_t* fileData, uint64_t chunkSize, uint8_t mode) {
+    Selection::Cursor cursor(selection, slot);
+
+    withMode(mode, [&](auto Mode) {
+        unpackBits<Mode>(fileData, chunkSize, [&]() { return imgData[cursor.next()]; });
+    });
+
+    return slot + dataSlots(chunkSize, mode);
+}
+
+//rows of whole byte groups can be filled one by one with the linear kernels, which keeps every row a contiguous run
+static bool rowAligned(const Region &region, uint8_t mode) {
+    return region.rowSlots % (mode == 3 ? 8 : 8 / mode) == 0;
+}
+
+//noise bit of consecutive slots, one noise word per 64 slots
+struct NoiseReader{
+    const MatchNoise &noise;
+    uint64_t slot;
+    uint64_t block = ~0ull, word = 0;
+
+    bool next(){
+        if(slot / 64 != block){
+            block = slot / 64;
+            word = noise.word(block);
+        }
+
+        return (word >> (slot++ % 64)) & 1;
+    }
+};
+
+//LSB matching versions of insertChunk and insertScattered, 'slot' is the data slot of the first channel and picks the noise
+//1 LSB without alpha is matched 16 channels at a time with SSE2
+uint64_t matchChunk(uint8_t* imgData, uint64_t imgIterator, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode, uint8_t channels, const MatchNoise &noise, uint64_t slot) {
+    if(mode == 1 && channels % 2 != 0){
+        matchContiguous(imgData + imgIterator, fileData, chunkSize * 8, noise, slot);
+        return imgIterator + chunkSize * 8;
+    }
+
+    NoiseReader reader{noise, slot};
+
+    withMode(mode, [&](auto Mode) {
+        walkChannels(imgIterator, channels, [&](auto next) {
+            packBits<Mode>(fileData, chunkSize, [&](uint8_t bits) {
+                uint8_t &value = imgData[next()];
+                value = matchChannel(value, bits, Mode, reader.next());
+            });
+        });
+    });
+
+    return imgIterator;
+}
+
+uint64_t matchScattered(uint8_t* imgData, const Scatter &scatter, uint64_t slot, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode, const MatchNoise &noise) {
+    NoiseReader reader{noise, slot};
+
+    withMode(mode, [&](auto Mode) {
+        packBits<Mode>(fileData, chunkSize, [&](uint8_t bits) {
+            uint8_t &value = imgData[scatter.position(slot++)];
+            value = matchChannel(value, bits, Mode, reader.next());
+        });
+    });
+
+    return slot;
+}
+
+//region of interest layout: data slot k is written to region.index(k), with the matching noise if there is one
+//returns the slot after the last written one
+uint64_t insertRegion(uint8_t* imgData, const Region &region, uint64_t slot, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode, const MatchNoise* noise) {
+    if(rowAligned(region, mode)){
+        for (uint64_t done = 0; done < chunkSize;){
+            uint64_t bytes = std::min<uint64_t>(chunkSize - done, (region.rowSlots - slot % region.rowSlots) * mode / 8);
+
+            if(noise)
+                matchChunk(imgData, region.index(slot), fileData + done, bytes, mode, region.channels, *noise, slot);
+            else
+                insertChunk(imgData, region.index(slot), fileData + done, bytes, mode, region.channels);
+
+            slot += dataSlots(bytes, mode);
+            done += bytes;
+        }
+
+        return slot;
+    }
+
+    withMode(mode, [&](auto Mode) {
+        walkRegion(region, slot, [&](auto next) {
+            if(noise){
+                NoiseReader reader{*noise, slot};
+                packBits<Mode>(fileData, chunkSize, [&](uint8_t bits) {
+                    uint8_t &value = imgData[next()];
+                    value = matchChannel(value, bits, Mode, reader.next());
+                });
+            }
+            else{
+                packBits<Mode>(fileData, chunkSize, [&](uint8_t bits) {
+                    uint8_t &value = imgData[next()];
+                    value = (value & ~((1 << Mode) - 1)) | bits;
+                });
+            }
+        });
+    });
+
+    return slot + dataSlots(chunkSize, mode);
+}
+
+uint64_t retrieveRegion(const uint8_t* imgData, const Region &region, uint64_t slot, uint8_t* fileData, uint64_t chunkSize, uint8_t mode) {
+    if(rowAligned(region, mode)){
+        for (uint64_t done = 0; done < chunkSize;){
+            uint64_t bytes = std::min<uint64_t>(chunkSize - done, (region.rowSlots - slot % region.rowSlots) * mode / 8);
+
+            retrieveChunk(imgData, region.index(slot), fileData + done, bytes, mode, region.channels);
+
+            slot += dataSlots(bytes, mode);
+            done += bytes;
+        }
+
+        return slot;
+    }
+
+    withMode(mode, [&](auto Mode) {
+        walkRegion(region, slot, [&](auto next) {
+            unpackBits<Mode>(fileData, chunkSize, [&]() { return imgData[next()]; });
+        });
+    });
+
+    return slot + dataSlots(chunkSize, mode);
+}
+
+//calls work(channels, lsbs, count, slot) for every coded segment of the data with its channel indices and their LSBs
+//segments start at 'slot' and are laid out by the scatter, the adaptive selection or in order through the region
+template<typename Work>
+static void forSegments(const uint8_t* imgData, const Region &region, const Scatter* scatter, const Selection* selection, uint64_t slot, uint64_t size, const Header &header, Work work) {
+    thread_local std::vector<uint64_t> indices;
+    thread_local std::vector<uint8_t> lsbs;
+
+    for (uint64_t segment = 0; segment < size; segment += codingSegment){
+        uint64_t bytes = std::min<uint64_t>(codingSegment, size - segment);
+        uint64_t count = segmentSlots(header, bytes);
+
+        indices.resize(count);
+        lsbs.resize(count);
+
+        if(scatter){
+            for (uint64_t i = 0; i < count; i++)
+                indices[i] = scatter->position(slot + i);
+        }
+        else if(selection){
+            Selection::Cursor cursor(*selection, slot);
+            for (uint64_t i = 0; i < count; i++)
+                indices[i] = cursor.next();
+        }
+        else{
+            walkRegion(region, slot, [&](auto next) {
+                for (uint64_t i = 0; i < count; i++)
+                    indices[i] = next();
+            });
+        }
+
+        for (uint64_t i = 0; i < count; i++)
+            lsbs[i] = imgData[indices[i]] & 1;
+
+        work(indices.data(), lsbs.data(), segment, bytes, slot);
+        slot += count;
+    }
+}
+
+//syndrome coded versions of the kernels, 'slot' is the first channel of the data after the header (scatter and selection are nullptr when linear)
+//'costs' is the STC cost of every data slot or nullptr, returns the slot after the last channel of the data
+uint64_t insertCoded(uint8_t* imgData, const Region &region, const Scatter* scatter, const Selection* selection, uint64_t slot, const uint8_t* fileData, uint64_t size, const Header &header, const MatchNoise* noise, const uint8_t* costs) {
+    forSegments(imgData, region, scatter, selection, slot, size, header, [&](const uint64_t* indices, uint8_t* lsbs, uint64_t segment, uint64_t bytes, uint64_t first) {
+        if(header.coding == Header::hamming)
+            hammingEmbed(lsbs, fileData + segment, bytes, header.codingParam);
+        else
+            stcEmbed(lsbs, costs ? costs + first : nullptr, fileData + segment, bytes, header.codingParam);
+
+        //only the channels whose LSB changed are written, by +-1 with matching noise
+        uint64_t count = segmentSlots(header, bytes);
+        for (uint64_t i = 0; i < count; i++){
+            uint8_t &value = imgData[indices[i]];
+            if((value & 1) != lsbs[i])
+                value = noise ? matchChannel(value, lsbs[i], 1, noise->bit(first + i)) : value ^ 1;
+        }
+    });
+
+    return slot + dataSlots(header, size);
+}
+
+uint64_t retrieveCoded(const uint8_t* imgData, const Region &region, const Scatter* scatter, const Selection* selection, uint64_t slot, uint8_t* fileData, uint64_t size, const Header &header) {
+    forSegments(imgData, region, scatter, selection, slot, size, header, [&](const uint64_t*, const uint8_t* lsbs, uint64_t segment, uint64_t bytes, uint64_t) {
+        if(header.coding == Header::hamming)
+            hammingExtract(lsbs, fileData + segment, bytes, header.codingParam);
+        else
+            stcExtract(lsbs, fileData + segment, bytes, header.codingParam);
+    });
+
+    return slot + dataSlots(header, size);
+}
+
+//keystream block 'index' of the data cipher with 'domain' flipped in IV byte 8, keys for everything that is not file data
+template<typename Cipher>
+static void derivedKey(const Cipher &cipher, const uint8_t* iv, uint8_t domain, uint64_t index, uint8_t* key, uint64_t size){
+    uint8_t derivedIv[aesBlockSize], counter[aesBlockSize];
+    std::copy_n(iv, aesBlockSize, derivedIv);
+    derivedIv[8] ^= domain;
+
+    cipher.seek(counter, derivedIv, index * chachaBlockSize);
+    std::fill_n(key, size, 0);
+    cipher.ctr(counter, key, size);
+}
+
+//IV of the keystreams of an entry, the image IV for the first one
+void entryIv(const uint8_t* iv, const Header &header, uint8_t* entry){
+    std::copy_n(iv, aesBlockSize, entry);
+
+    //the index goes where the block counter can't reach it: the top of the AES counter, the nonce of ChaCha20
+    int first = header.cipher == Header::chacha20 ? 12 : 0;
+    for (int i = 0; i < 4; i++)
+        entry[first + i] ^= header.entry >> (i * 8);
+}
+
+//IV of the keystreams of an entry after 'generation' updates, next to the entry index but never reached by the counter
+static const uint8_t* generationIv(const uint8_t* iv, const Header &header, uint32_t generation, uint8_t* buffer){
+    if(generation == 0)
+        return iv;
+
+    std::copy_n(iv, aesBlockSize, buffer);
+
+    int first = header.cipher == Header::chacha20 ? 9 : 4;
+    for (int i = 0; i < 3; i++)
+        buffer[first + i] ^= generation >> (i * 8);
+
+    return buffer;
+}
+
+//IV of the data keystream and tag of chunk 'index'
+static const uint8_t* chunkIv(const uint8_t* iv, const Header &header, uint64_t index, uint8_t* buffer){
+    return generationIv(iv, header, header.generations.empty() ? 0 : header.generations[index], buffer);
+}
+
+//one-time Poly1305 key of tag 'index'
+template<typename Cipher>
+static void macKey(const Cipher &cipher, const uint8_t* iv, uint64_t index, uint8_t* key){
+    derivedKey(cipher, iv, 0x80, index, key, poly1305KeySize);
+}
+
+//scatter layout of the data channels after the header
+template<typename Cipher>
+static std::optional<Scatter> makeScatter(const Cipher &cipher, const uint8_t* iv, Image &inputImage, const Header &header, uint64_t dataIterator){
+    if(header.layout == Header::linear)
+        return std::nullopt;
+
+    uint8_t seed[Scatter::seedSize];
+    derivedKey(cipher, iv, 0x40, 0, seed, sizeof(seed));
+
+    uint64_t slots = inputImage.size_no_alpha() - usableBefore(dataIterator, inputImage.channels());
+    std::optional<Scatter> scatter(std::in_place, seed, dataIterator, slots, header.layout == Header::tiled ? header.tileSize : 0, inputImage.channels());
+
+    std::fill_n(seed, sizeof(seed), 0);
+    return scatter;
+}
+
+//LSB matching noise, from the key so the same key gives the same image, random without one
+template<typename Cipher>
+static std::optional<MatchNoise> makeNoise(const Cipher *cipher, const uint8_t* iv, bool matching){
+    if(!matching)
+        return std::nullopt;
+
+    uint8_t seed[MatchNoise::seedSize];
+    if(cipher)
+        derivedKey(*cipher, iv, 0x20, 0, seed, sizeof(seed));
+    else
+        randomBytes(seed, sizeof(seed));
+
+    std::optional<MatchNoise> noise(std::in_place, seed);
+
+    std::fill_n(seed, sizeof(seed), 0);
+    return noise;
+}
+
+//tag of chunk 'index' as stored in the image, chunk index and data size are the associated data
+template<typename Cipher>
+static void chunkTag(const Cipher &cipher, const uint8_t* iv, const Header &header, uint64_t index, const uint8_t* data, uint64_t size, uint8_t* tag){
+    uint8_t key[poly1305KeySize], aad[16];
+    macKey(cipher, iv, index, key);
+
+    for (int i = 0; i < 8; i++){
+        aad[i] = index >> (i * 8);
+        aad[8 + i] = header.dataSize >> (i * 8);
+    }
+
+    poly1305Aead(tag, key, aad, sizeof(aad), data, size);
+}
+
+template<typename Cipher>
+static void headerTag(const Cipher &cipher, const uint8_t* iv, const Header &header, uint8_t* tag){
+    //every update of the header is tagged with a key of its own
+    uint8_t key[poly1305KeySize], buffer[aesBlockSize];
+    macKey(cipher, generationIv(iv, header, header.updates, buffer), header.chunkCount(), key);
+
+    std::vector<uint8_t> data = header.authenticated();
+
+    Poly1305 mac(key);
+    mac.update(data.data(), data.size());
+    mac.finish(tag);
+}
+
+//writes a chunk of stored data from 'slot' with the layout and coding of the header, imgIterator follows the linear layout
+static uint64_t embedChunk(uint8_t* imgData, const Region &region, const Scatter* scatter, const Selection* selection, const MatchNoise* noise, const uint8_t* costs,
+                           uint64_t slot, uint64_t &imgIterator, const uint8_t* fileData, uint64_t length, const Header &header, uint8_t channels){
+    if(header.flags & Header::codingFlag)
+        return insertCoded(imgData, region, scatter, selection, slot, fileData, length, header, noise, costs);
+
+    if(selection)
+        return insertSelected(imgData, *selection, slot, fileData, length, header.mode);
+
+    if(scatter && noise)
+        return matchScattered(imgData, *scatter, slot, fileData, length, header.mode, *noise);
+
+    if(scatter)
+        return insertScattered(imgData, *scatter, slot, fileData, length, header.mode);
+
+    if(header.flags & Header::roiFlag)
+        return insertRegion(imgData, region, slot, fileData, length, header.mode, noise);
+
+    if(noise)
+        imgIterator = matchChunk(imgData, imgIterator, fileData, length, header.mode, channels, *noise, slot);
+    else
+        imgIterator = insertChunk(imgData, imgIterator, fileData, length, header.mode, channels);
+
+    return slot + dataSlots(header, length);
+}
+
+//STC flip cost of every selected channel, in slot order
+static std::vector<uint8_t> stcSlotCosts(const CostMap &costs, const Selection &selection, uint64_t count){
+    std::vector<uint8_t> slotCosts(count);
+
+    runParallel(count, 64, [&](uint64_t first, uint64_t size) {
+        Selection::Cursor cursor(selection, first);
+        for (uint64_t i = first; i < first + size; i++)
+            slotCosts[i] = stcCost(costs.cost(cursor.next()));
+    });
+
+    return slotCosts;
+}
+
+//writes the v2 header at 1 LSB from channel 'start', right after the legacy mode bit for the first entry
+void writeHeader(Image &inputImage, const Header &header, Key *inputKey, uint64_t start) {
+    Span span("header", header.size());
+
+    std::vector<uint8_t> headerData = header.serialize();
+
+    if(inputKey){
+        const Aes<16> &cipher = inputKey->headerCipher(); //using iv as key to encrypt header in ECB
+        cipher.encryptBlock(headerData.data());
+
+        uint8_t counter[aesBlockSize]; //rest of the header in CTR with encrypted block 0 as counter
+        std::copy_n(headerData.data(), aesBlockSize, counter);
+        cipher.ctr(counter, headerData.data() + Header::blockSize, headerData.size() - Header::blockSize);
+    }
+
+    uint8_t *imgData = inputImage.data();
+    if(start == 1)
+        imgData[0] &= ~1; //legacy mode bit, v1 readers will look for their marker at 1 LSB
+
+    insertChunk(imgData, start, headerData.data(), headerData.size(), 1, inputImage.channels());
+}
+
+Header insertData(Image &inputImage, File &inputFile, Key *inputKey, const InsertOptions &options){
+    
+    uint8_t *imgData = inputImage.data();
+    uint8_t *fileData = inputFile.data();
+    uint8_t channels = inputImage.channels();
+
+    Header header;
+    header.dataSize = inputFile.size();
+
+    if(inputKey){
+        header.flags |= Header::cipherFlag | Header::generationFlag;
+        header.cipher = inputKey->cipher();
+
+        if(options.authenticate)
+            header.flags |= Header::authFlag;
+
+        if(options.layout != Header::linear){
+            header.flags |= Header::layoutFlag;
+            header.layout = options.layout;
+            header.tileSize = options.layout == Header::tiled ? scatterTileSize : 0;
+        }
+        header.keySize = std::visit([](const auto &cipher) { return (uint8_t)cipher.keySize; }, inputKey->dataCipher());
+    }
+
+    if(options.coding != Header::uncoded){
+        header.flags |= Header::codingFlag;
+        header.coding = options.coding;
+    }
+
+    //costs only ignore the replaced LSBs, +-1 can carry into any bit and Hamming flips don't follow costs
+    if(options.adaptive){
+        if(header.flags & Header::layoutFlag || options.matching || options.coding == Header::hamming)
+            throw std::runtime_error("Adaptive embedding needs the linear layout and can't be used with matching or Hamming coding.");
+
+        header.flags |= Header::adaptiveFlag;
+    }
+
+    if(options.matching)
+        header.flags |= Header::matchingFlag;
+
+    if(options.entry != 0){
+        header.flags |= Header::entryFlag;
+        header.entry = options.entry;
+        header.previous = options.previous;
+    }
+
+    if(options.roi[2] != 0){
+        if(header.flags & (Header::layoutFlag | Header::adaptiveFlag))
+            throw std::runtime_error("A region of interest needs the linear layout and can't be used with adaptive embedding.");
+
+        header.flags |= Header::roiFlag;
+        header.roiX = options.roi[0];
+        header.roiY = options.roi[1];
+        header.roiWidth = options.roi[2];
+        header.roiHeight = options.roi[3];
+
+        if(header.roiHeight == 0 || (uint64_t)header.roiX + header.roiWidth > (uint64_t)inputImage.width() || (uint64_t)header.roiY + header.roiHeight > (uint64_t)inputImage.height())
+            throw std::runtime_error("Region of interest " + std::to_string(header.roiX) + ',' + std::to_string(header.roiY) + ',' + std::to_string(header.roiWidth) + ',' + std::to_string(header.roiHeight) +
+                                     " is not inside the " + std::to_string(inputImage.width()) + 'x' + std::to_string(inputImage.height()) + " image.");
+
+        //smallest header this data can have, selectMode would only report that nothing fits
+        Header smallest = header;
+        smallest.mode = Header::maxMode;
+        smallest.chunkSize = modeChunkSize(smallest.mode);
+
+        uint64_t headerEnd = skipChannels(options.start, (uint64_t)smallest.size() * 8, channels);
+        if(headerEnd > dataRegion(inputImage, header, 0).start)
+            throw std::runtime_error("The region of interest has to start after the header, which takes the first " + std::to_string(headerEnd / channels + 1) + " pixels.");
+    }
+
+    std::vector<uint8_t> compressed;
+    if(options.compress){
+        compressed = compressData(fileData, inputFile.size(), header);
+        fileData = compressed.data();
+    }
+
+    selectMode(inputImage, header, options.start);
+
+    header.chunkCrc.resize(header.chunkCount());
+
+    if(header.flags & Header::generationFlag)
+        header.generations.resize(header.chunkCount());
+
+    bool authenticated = header.flags & Header::authFlag;
+    if(authenticated)
+        header.chunkTags.resize(header.chunkCount());
+
+    //data starts right after the header
+    uint64_t dataIterator = skipChannels(options.start, (uint64_t)header.size() * 8, channels);
+    Region region = dataRegion(inputImage, header, dataIterator);
+
+    //costs come from the cover, the embedded bits don't change them
+    std::optional<CostMap> costs;
+    std::optional<Selection> selection;
+    std::vector<uint8_t> slotCosts;
+
+    if(header.flags & Header::adaptiveFlag){
+        costs.emplace(inputImage, header.mode);
+        header.threshold = adaptiveThreshold(*costs, dataIterator, dataSlots(header, header.dataSize));
+        selection.emplace(*costs, dataIterator, header.threshold);
+
+        if(header.flags & Header::codingFlag)
+            slotCosts = stcSlotCosts(*costs, *selection, dataSlots(header, header.dataSize));
+    }
+
+    uint8_t iv[aesBlockSize] = {};
+    if(inputKey)
+        entryIv(inputKey->IV(), header, iv);
+
+    // encrypting, checksumming and inserting file data chunk by chunk through threads
+    withCipher(inputKey, [&](const auto *cipher) {
+        std::optional<Scatter> scatter;
+        if(cipher)
+            scatter = makeScatter(*cipher, iv, inputImage, header, dataIterator);
+
+        std::optional<MatchNoise> noise = makeNoise(cipher, iv, options.matching);
+
+        runParallel(header.dataSize, header.chunkSize, [&](uint64_t offset, uint64_t size) {
+            uint8_t counter[aesBlockSize];
+            if(cipher)
+                cipher->seek(counter, iv, offset);
+
+            uint64_t slot = dataSlots(header, offset);
+            uint64_t imgIterator = skipChannels(dataIterator, slot, channels);
+
+            for (uint64_t chunk = offset; chunk < offset + size; chunk += header.chunkSize){
+                uint64_t length = std::min<uint64_t>(header.chunkSize, offset + size - chunk);
+
+                if(cipher){
+                    Span span("encrypt", length);
+                    cipher->ctr(counter, (fileData + chunk), length);
+                }
+
+                {
+                    Span span("crc", length);
+                    header.chunkCrc[chunk / header.chunkSize] = crc32c(fileData + chunk, length);
+                }
+
+                if(authenticated){
+                    Span span("mac", length);
+                    chunkTag(*cipher, iv, header, chunk / header.chunkSize, fileData + chunk, length, header.chunkTags[chunk / header.chunkSize].data());
+                }
+
+                Span span("embed", length);
+                slot = embedChunk(imgData, region, scatter ? &*scatter : nullptr, selection ? &*selection : nullptr, noise ? &*noise : nullptr, slotCosts.empty() ? nullptr : slotCosts.data(),
+                                  slot, imgIterator, (fileData + chunk), length, header, channels);
+            }
+        });
+
+        //covers the chunk tags as well, so chunks can't be dropped, reordered or swapped with other images
+        if(authenticated)
+            headerTag(*cipher, iv, header, header.headerTag.data());
+    });
+
+    writeHeader(inputImage, header, inputKey, options.start);
+
+    return header;
+}
+
+//slot of a key in a directory, the header cipher of a fixed block so it says nothing about the data key
+std::array<uint8_t, Header::slotIdSize> slotId(Key *inputKey) {
+    std::array<uint8_t, Header::slotIdSize> id{};
+    if(!inputKey)
+        return id;
+
+    uint8_t block[aesBlockSize] = {'P', 'X', 'S', 'L', 'O', 'T', 'I', 'D'};
+    inputKey->headerCipher().encryptBlock(block);
+
+    std::copy_n(block, id.size(), id.begin());
+    return id;
+}
+
+//rows are split between the slots in proportion to their file sizes, after the rows of the directory
+std::vector<Header> insertSlots(Image &inputImage, const std::vector<File*> &files, const std::vector<Key*> &keys, const InsertOptions &options){
+    Header directory;
+    directory.flags = Header::slotsFlag;
+    directory.slots.resize(files.size());
+
+    if(files.empty() || files.size() > UINT16_MAX)
+        throw std::runtime_error("Invalid number of slots: " + std::to_string(files.size()) + '.');
+
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < files.size(); i++){
+        directory.slots[i].keyId = slotId(keys[i]);
+        total += files[i]->size();
+
+        for (uint64_t j = 0; j < i; j++)
+            if(directory.slots[j].keyId == directory.slots[i].keyId)
+                throw std::runtime_error("Every slot needs a different key.");
+    }
+
+    uint64_t rowChannels = inputImage.size_no_alpha() / inputImage.height();
+    uint64_t directoryRows = (1 + (uint64_t)directory.size() * 8 + rowChannels - 1) / rowChannels;
+
+    if(directoryRows + files.size() > (uint64_t)inputImage.height())
+        throw std::runtime_error("Image is too small for " + std::to_string(files.size()) + " slots.");
+
+    uint64_t rows = inputImage.height() - directoryRows, before = 0;
+
+    for (uint64_t i = 0; i < files.size(); i++){
+        Header::Slot &slot = directory.slots[i];
+
+        //at least one row per slot, the remaining rows follow the sizes
+        before += files[i]->size();
+        uint64_t end = directoryRows + (i + 1) + (unsigned __int128)(rows - files.size()) * before / total;
+
+        slot.firstRow = i == 0 ? directoryRows : directory.slots[i - 1].firstRow + directory.slots[i - 1].rows;
+        slot.rows = end - slot.firstRow;
+    }
+
+    //one runner per slot, or per thread when there are more slots, every runner gets an equal share of the threads
+    std::vector<Header> headers(files.size());
+    std::vector<std::exception_ptr> errors(files.size());
+    std::atomic<uint64_t> next = 0;
+
+    unsigned int runners = std::min<uint64_t>(files.size(), numThreads);
+    unsigned int share = numThreads / runners, extra = numThreads % runners;
+
+    auto run = [&](unsigned int runner) {
+        threadShare = {share + (runner < extra), runner * share + std::min(runner, extra)};
+        Stats::setWorker(threadShare.firstWorker);
+
+        for (uint64_t i = next++; i < files.size(); i = next++){
+            Image view(inputImage, directory.slots[i].firstRow, directory.slots[i].rows);
+
+            try{
+                headers[i] = insertData(view, *files[i], keys[i], options);
+            }
+            catch(...){
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int runner = 1; runner < runners; runner++)
+        threads.emplace_back(run, runner);
+
+    ThreadShare own = threadShare;
+    run(0);
+    threadShare = own;
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    for (uint64_t i = 0; i < files.size(); i++){
+        if(errors[i]){
+            try{
+                std::rethrow_exception(errors[i]);
+            }
+            catch(const std::exception &e){
+                throw std::runtime_error("Slot " + std::to_string(i + 1) + ": " + e.what());
+            }
+        }
+
+        directory.slots[i].dataSize = headers[i].dataSize;
+    }
+
+    writeHeader(inputImage, directory, nullptr);
+
+    return headers;
+}
+
+//plain slot directory at the top of the image, false if there is none
+bool readDirectory(Image &inputImage, Header &directory){
+    uint8_t *imgData = inputImage.data();
+    uint8_t channels = inputImage.channels();
+
+    if(imgData[0] & 1)
+        return false;
+
+    uint8_t block[aesBlockSize];
+    uint64_t imgIterator = retrieveChunk(imgData, 1, block, aesBlockSize, 1, channels);
+
+    uint32_t headerSize = Header::parseBlock(block);
+    if(headerSize == 0 || (uint64_t)headerSize * 8 > inputImage.size_no_alpha() - 1)
+        return false;
+
+    std::vector<uint8_t> headerData(block, block + Header::blockSize);
+    headerData.resize(headerSize);
+    retrieveChunk(imgData, imgIterator, headerData.data() + Header::blockSize, headerSize - Header::blockSize, 1, channels);
+
+    //plain single payload headers are read again by readHeader
+    Header header = Header::parse(headerData.data(), headerSize);
+    if(!(header.flags & Header::slotsFlag))
+        return false;
+
+    for (const Header::Slot &slot : header.slots)
+        if((uint64_t)slot.firstRow + slot.rows > (uint64_t)inputImage.height())
+            throw std::runtime_error("Corrupted header. Slot rows are outside the image.");
+
+    directory = std::move(header);
+    return true;
+}
+
+Image slotImage(Image &inputImage, Key *inputKey){
+    Header directory;
+    if(!readDirectory(inputImage, directory))
+        return Image(inputImage, 0, inputImage.height());
+
+    std::array<uint8_t, Header::slotIdSize> id = slotId(inputKey);
+    for (const Header::Slot &slot : directory.slots)
+        if(slot.keyId == id)
+            return Image(inputImage, slot.firstRow, slot.rows);
+
+    throw std::runtime_error(std::string("No slot for ") + (inputKey ? "this key" : "a payload without a key") + " in the image.");
+}
+
+//rest of a v2 header from its decrypted block 0, the header starts at channel 'start' and the rest at imgIterator
+//returns the header size, 0 if block 0 is not a v2 header
+static uint32_t readRest(Image &inputImage, Key *inputKey, const uint8_t* block, uint8_t* encryptedBlock, uint64_t imgIterator, uint64_t start, Header &header, uint64_t &dataIterator){
+    uint8_t *imgData = inputImage.data();
+    uint8_t channels = inputImage.channels();
+    uint64_t available = inputImage.size_no_alpha() - usableBefore(start, channels);
+
+    uint32_t headerSize = Header::parseBlock(block);
+    if(headerSize == 0)
+        return 0;
+
+    if((uint64_t)headerSize * 8 > available)
+        throw std::runtime_error("Corrupted header. The header length is invalid. Cannot retrieve the file.");
+
+    //retrieving rest of the v2 header
+    std::vector<uint8_t> headerData(block, block + Header::blockSize);
+    headerData.resize(headerSize);
+    dataIterator = retrieveChunk(imgData, imgIterator, headerData.data() + Header::blockSize, headerSize - Header::blockSize, 1, channels);
+
+    if(inputKey){
+        inputKey->headerCipher().ctr(encryptedBlock, headerData.data() + Header::blockSize, headerSize - Header::blockSize);
+    }
+
+    header = Header::parse(headerData.data(), headerSize);
+
+    //the first header has no entry index and appended ones always have one
+    if(((header.flags & Header::entryFlag) != 0) != (start != 1))
+        throw std::runtime_error("Corrupted header. Invalid entry index.");
+
+    if(inputKey)
+        inputKey->useCipher(header.cipher, header.keySize);
+
+    if(header.flags & Header::authFlag){
+        withCipher(inputKey, [&](const auto *cipher) {
+            uint8_t iv[aesBlockSize], tag[Header::tagSize];
+            entryIv(inputKey->IV(), header, iv);
+            headerTag(*cipher, iv, header, tag);
+
+            if(!tagsEqual(tag, header.headerTag.data()))
+                throw std::runtime_error("Authentication failed. The header was modified.");
+        });
+    }
+
+    if(!fits(inputImage, header, start))
+        throw std::runtime_error("Corrupted header. The message length in the header is invalid. Cannot retrieve the file.");
+
+    return headerSize;
+}
+
+//reads v1 or v2 header, returns false if there is no data in the image, data starts at dataIterator
+bool readHeader(Image &inputImage, Key *inputKey, Header &header, uint64_t &dataIterator){
+
+    Span span("header");
+
+    uint8_t *imgData = inputImage.data();
+    uint8_t channels = inputImage.channels();
+    uint64_t available = inputImage.size_no_alpha() - 1;
+
+    //retrieving legacy mode
+    uint8_t mode = (imgData[0] & 1) + 1;
+
+    //v1 marker + size and v2 block 0 are stored at the same place
+    uint8_t block[aesBlockSize], encryptedBlock[aesBlockSize];
+    uint64_t imgIterator = retrieveChunk(imgData, 1, block, aesBlockSize, mode, channels);
+    std::copy(block, block + aesBlockSize, encryptedBlock);
+
+    if(inputKey)
+        inputKey->headerCipher().decryptBlock(block);
+
+    //v1 images: data follows the 129 bit header with the same mode
+    if(std::equal(headerMarker.begin(), headerMarker.end(), block)){
+        header = Header();
+        header.version = 1;
+        header.mode = mode;
+
+        for (int i = 0; i < 8; i++)
+            header.dataSize |= uint64_t(block[8 + i]) << (i * 8);
+
+        if(header.dataSize < 1 || header.dataSize > (mode * available / 8) - headerMarker.length() - sizeof(int64_t))
+            throw std::runtime_error("Corrupted header. The message length in the header is invalid. Cannot retrieve the file.");
+
+        if(inputKey)
+            inputKey->useCipher(header.cipher, header.keySize);
+
+        dataIterator = imgIterator;
+        return true;
+    }
+
+    if(mode != 1)
+        return false;
+
+    uint32_t headerSize = readRest(inputImage, inputKey, block, encryptedBlock, imgIterator, 1, header, dataIterator);
+
+    span.bytes(headerSize);
+    return headerSize != 0;
+}
+
+//byte ranges of the marked chunks, adjacent chunks are merged
+static std::string chunkRanges(const Header &header, const std::vector<uint8_t> &marked){
+    std::string ranges;
+    for (uint64_t i = 0; i < marked.size(); i++){
+        if(!marked[i])
+            continue;
+
+        uint64_t first = i;
+        while (i + 1 < marked.size() && marked[i + 1])
+            i++;
+
+        ranges += (ranges.empty() ? "" : ", ") + std::to_string(first * header.chunkSize) + '-' + std::to_string(std::min<uint64_t>((i + 1) * header.chunkSize, header.dataSize) - 1);
+    }
+
+    return ranges;
+}
+
+//retrieves data bytes [offset, offset + size) into fileData using threads
+//offset must be a multiple of the chunk size (aesBlockSize for v1), every thread verifies the CRCs and tags of its own chunks
+void extractData(Image &inputImage, Key *inputKey, const Header &header, uint64_t dataIterator, uint64_t offset, uint64_t size, uint8_t* fileData){
+
+    uint8_t *imgData = inputImage.data();
+    uint8_t channels = inputImage.channels();
+
+    bool checked = header.version >= 2;
+    uint64_t unit = checked ? header.chunkSize : aesBlockSize;
+
+    bool authenticated = header.flags & Header::authFlag;
+
+    std::vector<uint8_t> corrupted(checked ? header.chunkCount() : 0, 0);
+    std::vector<uint8_t> forged(authenticated ? header.chunkCount() : 0, 0);
+
+    Region region = dataRegion(inputImage, header, dataIterator);
+
+    std::optional<Selection> selection;
+    if(header.flags & Header::adaptiveFlag)
+        selection.emplace(CostMap(inputImage, header.mode), dataIterator, header.threshold);
+
+    uint8_t iv[aesBlockSize] = {};
+    if(inputKey)
+        entryIv(inputKey->IV(), header, iv);
+
+    withCipher(inputKey, [&](const auto *cipher) {
+        std::optional<Scatter> scatter;
+        if(cipher)
+            scatter = makeScatter(*cipher, iv, inputImage, header, dataIterator);
+
+        runParallel(size, unit, [&](uint64_t partOffset, uint64_t partSize) {
+            uint64_t first = offset + partOffset;
+
+            //position and counter of any byte can be computed directly, scattered slots are permuted one by one
+            uint8_t counter[aesBlockSize];
+            if(cipher)
+                cipher->seek(counter, iv, first);
+
+            uint64_t slot = dataSlots(header, first);
+            uint64_t imgIterator = skipChannels(dataIterator, slot, channels);
+            uint64_t step = checked ? header.chunkSize : partSize;
+
+            for (uint64_t chunk = partOffset; chunk < partOffset + partSize; chunk += step){
+                uint64_t length = std::min<uint64_t>(step, partOffset + partSize - chunk);
+
+                //updated chunks have a keystream of their own
+                uint8_t buffer[aesBlockSize];
+                const uint8_t* dataIv = iv;
+                if(cipher && (header.flags & Header::generationFlag)){
+                    dataIv = chunkIv(iv, header, (offset + chunk) / header.chunkSize, buffer);
+                    cipher->seek(counter, dataIv, offset + chunk);
+                }
+
+                {
+                    Span span("extract", length);
+                    if(header.flags & Header::codingFlag)
+                        slot = retrieveCoded(imgData, region, scatter ? &*scatter : nullptr, selection ? &*selection : nullptr, slot, (fileData + chunk), length, header);
+                    else if(selection)
+                        slot = retrieveSelected(imgData, *selection, slot, (fileData + chunk), length, header.mode);
+                    else if(scatter)
+                        slot = retrieveScattered(imgData, *scatter, slot, (fileData + chunk), length, header.mode);
+                    else if(header.flags & Header::roiFlag)
+                        slot = retrieveRegion(imgData, region, slot, (fileData + chunk), length, header.mode);
+                    else
+                        imgIterator = retrieveChunk(imgData, imgIterator, (fileData + chunk), length, header.mode, channels);
+                }
+
+                if(checked){
+                    Span span("crc", length);
+                    if(crc32c(fileData + chunk, length) != header.chunkCrc[(offset + chunk) / header.chunkSize])
+                        corrupted[(offset + chunk) / header.chunkSize] = 1;
+                }
+
+                if(authenticated){
+                    Span span("mac", length);
+                    uint64_t index = (offset + chunk) / header.chunkSize;
+                    uint8_t tag[Header::tagSize];
+                    chunkTag(*cipher, dataIv, header, index, fileData + chunk, length, tag);
+
+                    if(!tagsEqual(tag, header.chunkTags[index].data()))
+                        forged[index] = 1;
+                }
+
+                if(cipher){
+                    Span span("decrypt", length);
+                    cipher->ctr(counter, (fileData + chunk), length);
+                }
+            }
+        });
+    });
+
+    std::string ranges = chunkRanges(header, corrupted);
+    if(!ranges.empty())
+        throw std::runtime_error("Integrity check failed. Corrupted data at bytes " + ranges + '.');
+
+    ranges = chunkRanges(header, forged);
+    if(!ranges.empty())
+        throw std::runtime_error("Authentication failed. The data at bytes " + ranges + " was modified.");
+}
+
+//retrieves any data range, it is widened to whole chunks so their CRCs can still be verified
+void readData(Image &inputImage, Key *inputKey, const Header &header, uint64_t dataIterator, uint64_t offset, uint64_t size, uint8_t* fileData){
+    uint64_t unit = header.version >= 2 ? header.chunkSize : aesBlockSize;
+    uint64_t first = (offset / unit) * unit;
+    uint64_t last = std::min<uint64_t>(((offset + size + unit - 1) / unit) * unit, header.dataSize);
+
+    std::vector<uint8_t> data(last - first);
+    extractData(inputImage, inputKey, header, dataIterator, first, last - first, data.data());
+
+    std::copy(data.begin() + (offset - first), data.begin() + (offset - first + size), fileData);
+}
+
+//retrieves bytes [offset, offset + size) of the file data, only the compressed blocks covering the range are decompressed
+void readFileData(Image &inputImage, Key *inputKey, const Header &header, uint64_t dataIterator, uint64_t offset, uint64_t size, uint8_t* fileData){
+    if(!(header.flags & Header::compressedFlag)){
+        readData(inputImage, inputKey, header, dataIterator, offset, size, fileData);
+        return;
+    }
+
+    uint64_t firstBlock = offset / header.compressBlockSize;
+    uint64_t lastBlock = (offset + size - 1) / header.compressBlockSize + 1;
+
+    uint64_t storedOffset = 0, storedSize = 0;
+    for (uint64_t block = 0; block < lastBlock; block++)
+        (block < firstBlock ? storedOffset : storedSize) += header.compressedSizes[block] & ~Header::rawBlock;
+
+    std::vector<uint8_t> stored(storedSize);
+    readData(inputImage, inputKey, header, dataIterator, storedOffset, storedSize, stored.data());
+
+    uint64_t blocksOffset = firstBlock * header.compressBlockSize;
+    std::vector<uint8_t> blocks(std::min<uint64_t>(lastBlock * header.compressBlockSize, header.originalSize) - blocksOffset);
+    decompressData(header, firstBlock, lastBlock - firstBlock, stored.data(), blocks.data());
+
+    std::copy(blocks.begin() + (offset - blocksOffset), blocks.begin() + (offset - blocksOffset + size), fileData);
+}
+
+//only plain v2 entries in image order end where their data ends
+static bool appendable(const Header &header){
+    return header.version >= 2 && (header.flags & (Header::layoutFlag | Header::adaptiveFlag | Header::slotsFlag | Header::roiFlag)) == 0;
+}
+
+//first channel after the data of an entry, where the header of the next one goes
+static uint64_t entryEnd(Image &inputImage, const Entry &entry){
+    return skipChannels(entry.dataIterator, dataSlots(entry.header, entry.header.dataSize), inputImage.channels());
+}
+
+//header of an appended entry at channel 'start', returns false if there is none
+static bool readEntryHeader(Image &inputImage, Key *inputKey, uint64_t start, Header &header, uint64_t &dataIterator){
+    uint8_t channels = inputImage.channels();
+    if(inputImage.size_no_alpha() - usableBefore(start, channels) < Header::blockSize * 8)
+        return false;
+
+    uint8_t block[aesBlockSize], encryptedBlock[aesBlockSize];
+    uint64_t imgIterator = retrieveChunk(inputImage.data(), start, block, aesBlockSize, 1, channels);
+    std::copy(block, block + aesBlockSize, encryptedBlock);
+
+    if(inputKey)
+        inputKey->headerCipher().decryptBlock(block);
+
+    return readRest(inputImage, inputKey, block, encryptedBlock, imgIterator, start, header, dataIterator) != 0;
+}
+
+std::vector<Entry> readEntries(Image &inputImage, Key *inputKey){
+    std::vector<Entry> entries(1);
+    if(!readHeader(inputImage, inputKey, entries[0].header, entries[0].dataIterator))
+        return {};
+
+    Span span("entries");
+
+    //an entry that doesn't follow the one before it is stale data of an earlier chain
+    Entry entry;
+    while (appendable(entries.back().header)){
+        entry.start = entryEnd(inputImage, entries.back());
+        if(!readEntryHeader(inputImage, inputKey, entry.start, entry.header, entry.dataIterator))
+            break;
+
+        if(entry.header.entry != entries.size() || entry.header.previous != entries.back().header.crc())
+            break;
+
+        entries.push_back(entry);
+    }
+
+    return entries;
+}
+
+Header appendData(Image &inputImage, File &inputFile, Key *inputKey, InsertOptions options){
+    std::vector<Entry> entries = readEntries(inputImage, inputKey);
+
+    if(entries.empty())
+        throw std::runtime_error("No data with this key was found in the image. Use --insert for the first file.");
+
+    if(!appendable(entries.back().header))
+        throw std::runtime_error("Data can only be appended after data inserted with the linear layout, without adaptive embedding or a region of interest.");
+
+    if(options.roi[2] != 0)
+        throw std::runtime_error("Appended data can't use a region of interest.");
+
+    options.start = entryEnd(inputImage, entries.back());
+    options.entry = entries.size();
+    options.previous = entries.back().header.crc();
+
+    if(inputImage.size_no_alpha() - usableBefore(options.start, inputImage.channels()) < Header::blockSize * 8)
+        throw std::runtime_error("The image is full. There is no space left after the existing data.");
+
+    return insertData(inputImage, inputFile, inputKey, options);
+}
+
+uint64_t dataExtent(Image &inputImage, Key *inputKey, uint8_t &mode){
+    Header directory;
+    if(readDirectory(inputImage, directory)){
+        //the modes of the slots are in their own encrypted headers, so every slot row is taken at the highest one
+        uint64_t rows = 0;
+        for (const Header::Slot &slot : directory.slots)
+            rows = std::max<uint64_t>(rows, (uint64_t)slot.firstRow + slot.rows);
+
+        mode = Header::maxMode;
+        return rows * inputImage.width() * inputImage.channels();
+    }
+
+    std::vector<Entry> entries = readEntries(inputImage, inputKey);
+    if(entries.empty())
+        return 0;
+
+    mode = 1; //headers are at 1 LSB
+    uint64_t end = 0;
+
+    for (const Entry &entry : entries){
+        const Header &header = entry.header;
+        mode = std::max(mode, header.mode);
+
+        //scattered and adaptive data can be anywhere after the header, they are always the last entry
+        if(header.flags & (Header::layoutFlag | Header::adaptiveFlag))
+            return inputImage.size();
+
+        if(header.flags & Header::roiFlag)
+            end = std::max(end, dataRegion(inputImage, header, entry.dataIterator).index(dataSlots(header, header.dataSize) - 1) + 1);
+        else
+            end = std::max(end, entryEnd(inputImage, entry));
+    }
+
+    return end;
+}
+
+//number of bytes that differ between a and b, 16 at a time with SSE2
+static uint64_t countDifferences(const uint8_t* a, const uint8_t* b, uint64_t size){
+    uint64_t count = 0, i = 0;
+
+#ifdef STEGO_SIMD
+    for (; i + 16 <= size; i += 16){
+        __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        count += 16 - __builtin_popcount(_mm_movemask_epi8(equal));
+    }
+#endif
+
+    for (; i < size; i++)
+        count += a[i] != b[i];
+
+    return count;
+}
+
+//recomputes the header tag of an entry and writes its header again, the bits that didn't change stay the same
+static void rewriteHeader(Image &inputImage, Key *inputKey, Header &header, uint64_t start){
+    if(inputKey)
+        inputKey->useCipher(header.cipher, header.keySize);
+
+    if(header.flags & Header::authFlag){
+        withCipher(inputKey, [&](const auto *cipher) {
+            uint8_t iv[aesBlockSize];
+            entryIv(inputKey->IV(), header, iv);
+            headerTag(*cipher, iv, header, header.headerTag.data());
+        });
+    }
+
+    writeHeader(inputImage, header, inputKey, start);
+}
+
+Update updateData(Image &inputImage, File &inputFile, Key *inputKey, uint32_t entry){
+    std::vector<Entry> entries = readEntries(inputImage, inputKey);
+
+    if(entries.empty())
+        throw std::runtime_error("No data with this key was found in the image. Use --insert.");
+
+    if(entry >= entries.size())
+        throw std::runtime_error("Entry " + std::to_string(entry + 1) + " not found, the image has " + std::to_string(entries.size()) + " entries.");
+
+    Header &header = entries[entry].header;
+    uint64_t dataIterator = entries[entry].dataIterator;
+
+    if(header.version < 2)
+        throw std::runtime_error("Data hidden by older versions has no chunk checksums and can't be updated. Use --insert.");
+
+    if(header.flags & Header::compressedFlag)
+        throw std::runtime_error("Compressed data can't be updated in place, the blocks of the new file don't line up with the old ones. Use --insert.");
+
+    if(inputFile.size() != header.dataSize)
+        throw std::runtime_error("The new file has to have the same size and extension length as the hidden one to be updated in place. Use --insert.");
+
+    //rewriting encrypted chunks with the keystream they had would give away the xor of the old and new data
+    //and let their one-time MAC keys be used twice
+    if((header.flags & Header::cipherFlag) && !(header.flags & Header::generationFlag))
+        throw std::runtime_error("This data was encrypted without update generations and can't be updated in place. Use --insert.");
+
+    if(inputKey)
+        inputKey->useCipher(header.cipher, header.keySize);
+
+    //the old data is checked against its checksums and tags, a damaged image is never updated
+    Memory old = Memory::arena(header.dataSize);
+    extractData(inputImage, inputKey, header, dataIterator, 0, header.dataSize, old.data());
+
+    Span span("update");
+
+    uint8_t *imgData = inputImage.data();
+    uint8_t *fileData = inputFile.data();
+    uint8_t channels = inputImage.channels();
+    bool authenticated = header.flags & Header::authFlag;
+
+    Region region = dataRegion(inputImage, header, dataIterator);
+
+    //threshold and costs come from the header and the stego image, the same ones the data was embedded with
+    std::optional<CostMap> costs;
+    std::optional<Selection> selection;
+    std::vector<uint8_t> slotCosts;
+
+    if(header.flags & Header::adaptiveFlag){
+        costs.emplace(inputImage, header.mode);
+        selection.emplace(*costs, dataIterator, header.threshold);
+
+        if(header.flags & Header::codingFlag)
+            slotCosts = stcSlotCosts(*costs, *selection, dataSlots(header, header.dataSize));
+    }
+
+    //changed bytes of every chunk, compared 16 at a time
+    std::vector<uint64_t> changed(header.chunkCount());
+
+    runParallel(header.dataSize, header.chunkSize, [&](uint64_t offset, uint64_t size) {
+        Span span("diff", size);
+
+        for (uint64_t chunk = offset; chunk < offset + size; chunk += header.chunkSize){
+            uint64_t length = std::min<uint64_t>(header.chunkSize, offset + size - chunk);
+            changed[chunk / header.chunkSize] = countDifferences(old.data() + chunk, fileData + chunk, length);
+        }
+    });
+
+    Update update;
+    for (uint64_t bytes : changed){
+        update.bytes += bytes;
+        update.chunks += bytes != 0;
+    }
+
+    if(update.chunks == 0){
+        update.header = header;
+        return update;
+    }
+
+    //changed chunks move to the next generation and get a fresh keystream and MAC key
+    if(header.flags & Header::generationFlag){
+        if(header.updates == Header::maxGeneration)
+            throw std::runtime_error("This data was updated " + std::to_string(Header::maxGeneration) + " times, the most it can be. Use --insert.");
+
+        header.updates++;
+        for (uint64_t index = 0; index < changed.size(); index++)
+            if(changed[index] != 0)
+                header.generations[index] = header.updates;
+    }
+
+    uint8_t iv[aesBlockSize] = {};
+    if(inputKey)
+        entryIv(inputKey->IV(), header, iv);
+
+    withCipher(inputKey, [&](const auto *cipher) {
+        std::optional<Scatter> scatter;
+        if(cipher)
+            scatter = makeScatter(*cipher, iv, inputImage, header, dataIterator);
+
+        //the changed channels are written the way the data was inserted
+        std::optional<MatchNoise> noise = makeNoise(cipher, iv, header.flags & Header::matchingFlag);
+
+        runParallel(header.dataSize, header.chunkSize, [&](uint64_t offset, uint64_t size) {
+            for (uint64_t chunk = offset; chunk < offset + size; chunk += header.chunkSize){
+                uint64_t length = std::min<uint64_t>(header.chunkSize, offset + size - chunk);
+                uint64_t index = chunk / header.chunkSize;
+
+                if(changed[index] == 0)
+                    continue;
+
+                //only the keystream blocks of the changed chunks are generated, from their new generation
+                uint8_t buffer[aesBlockSize];
+                const uint8_t* dataIv = chunkIv(iv, header, index, buffer);
+
+                if(cipher){
+                    Span span("encrypt", length);
+                    uint8_t counter[aesBlockSize];
+                    cipher->seek(counter, dataIv, chunk);
+                    cipher->ctr(counter, (fileData + chunk), length);
+                }
+
+                {
+                    Span span("crc", length);
+                    header.chunkCrc[index] = crc32c(fileData + chunk, length);
+                }
+
+                if(authenticated){
+                    Span span("mac", length);
+                    chunkTag(*cipher, dataIv, header, index, fileData + chunk, length, header.chunkTags[index].data());
+                }
+
+                //bits that didn't change are written with the value they already have, so only the changed channels are modified
+                Span span("embed", length);
+                uint64_t slot = dataSlots(header, chunk);
+                uint64_t imgIterator = skipChannels(dataIterator, slot, channels);
+                embedChunk(imgData, region, scatter ? &*scatter : nullptr, selection ? &*selection : nullptr, noise ? &*noise : nullptr, slotCosts.empty() ? nullptr : slotCosts.data(),
+                           slot, imgIterator, (fileData + chunk), length, header, channels);
+            }
+        });
+    });
+
+    rewriteHeader(inputImage, inputKey, header, entries[entry].start);
+
+    //entries after it are linked to the CRC of the header before them
+    for (uint64_t i = entry + 1; i < entries.size(); i++){
+        entries[i].header.previous = entries[i - 1].header.crc();
+        rewriteHeader(inputImage, inputKey, entries[i].header, entries[i].start);
+    }
+
+    update.header = header;
+    return update;
+}
+
+//extension is stored in reverse at the end of the file data
+std::string readExtension(Image &inputImage, Key *inputKey, const Header &header, uint64_t dataIterator){
+    uint64_t tailSize = std::min<uint64_t>(header.fileSize(), 256);
+    std::vector<uint8_t> tail(tailSize);
+    readFileData(inputImage, inputKey, header, dataIterator, header.fileSize() - tailSize, tailSize, tail.data());
+
+    std::string extension;
+    for (auto it = tail.rbegin(); it != tail.rend(); ++it){
+        if(*it == '\0')
+            return extension;
+
+        extension += *it;
+    }
+
+    throw std::runtime_error("Corrupted file data. Cannot retrieve the file.");
+}
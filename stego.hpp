@@ -0,0 +1,182 @@
+#ifndef STEGO_HPP
+#define STEGO_HPP
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "image.hpp"
+#include "file.hpp"
+#include "header.hpp"
+#include "stats.hpp"
+#include "numa.hpp"
+#include "aes.hpp"
+#include "scatter.hpp"
+#include "matching.hpp"
+#include "adaptive.hpp"
+
+extern std::string headerMarker;
+extern unsigned int numThreads;
+extern uint32_t crcChunkSize;
+extern uint32_t compressBlockSize;
+extern uint32_t scatterTileSize;
+
+//optional stages of insertData, the ones that need a key are ignored without one
+struct InsertOptions{
+	bool compress = false;
+	bool authenticate = false;         //needs a key
+	uint8_t layout = Header::linear;   //scatter layouts need a key
+	bool matching = false;             //LSB matching instead of replacement
+	uint8_t coding = Header::uncoded;  //syndrome coding at 1 LSB
+	bool adaptive = false;             //data only in low cost channels, linear layout with replacement or STC
+	std::array<uint32_t, 4> roi{};     //x, y, width and height of a region of interest in pixels, width 0 for the whole image
+	uint64_t start = 1;                //channel of the header, right after the legacy mode bit except for appended entries
+	uint32_t entry = 0;                //index of an appended entry, 0 for the first one
+	uint32_t previous = 0;             //header CRC of the entry before an appended one
+};
+
+//threads of the runParallel calls made by the calling thread: all of them by default, a share of them
+//for a thread that runs next to others (slots embedded at the same time), which also offsets its worker indices
+struct ThreadShare{
+	unsigned int threads = 0;     //0 for numThreads
+	unsigned int firstWorker = 0; //stats worker and NUMA part of the calling thread
+};
+
+extern thread_local ThreadShare threadShare;
+
+//splits data in parts of multiple of 'unit' bytes for each thread, work(offset, size) is called for every part
+//in NUMA local mode the thread of every part runs on the same node for any call with the same split
+//'threadCount' 0 uses the share of the calling thread
+template<typename Work>
+void runParallel(uint64_t dataSize, uint64_t unit, Work work, unsigned int threadCount = 0) {
+    unsigned int count = threadCount != 0 ? threadCount : threadShare.threads != 0 ? threadShare.threads : numThreads;
+    unsigned int first = threadShare.firstWorker;
+
+    std::vector<std::thread> threads;
+    uint64_t offset = 0, partSize = (dataSize / (count * unit)) * unit;
+
+    for (unsigned int i = 0; i < count - 1 && partSize > 0; ++i) {
+        threads.emplace_back([work, i, first](uint64_t offset, uint64_t size) {
+            Stats::setWorker(first + i + 1);
+            if (numaMode == Numa::local)
+                pinPart(first + i, numThreads);
+
+            work(offset, size);
+        }, offset, partSize);
+
+        offset += partSize;
+    }
+
+    //the main thread gets its own affinity back after the join
+    std::optional<PartPin> pin;
+    if (numaMode == Numa::local)
+        pin.emplace(first + (partSize > 0 ? count - 1 : 0), numThreads);
+
+    work(offset, dataSize - offset); //remaining data will be processed by main thread
+
+    Span span("join");
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+//calls work(cipher) with the data cipher of the key (nullptr without a key)
+//the key size is dispatched here once per job, work is instantiated for every size
+template<typename Work>
+void withCipher(Key *inputKey, Work work) {
+    if (inputKey)
+        std::visit([&](const auto &cipher) { work(&cipher); }, inputKey->dataCipher());
+    else
+        work(static_cast<const Aes<16>*>(nullptr));
+}
+
+//layout helpers
+uint64_t skipChannels(uint64_t imgIterator, uint64_t count, uint8_t channels);
+uint64_t usableBefore(uint64_t imgIterator, uint8_t channels);
+
+//channels of the linear layout: rows of 'rowSlots' usable channels 'stride' bytes apart from 'start',
+//data slot k is in row k / rowSlots, without a region of interest the whole image after the header is one row
+struct Region{
+	uint64_t start;
+	uint64_t rowSlots;
+	uint64_t stride;
+	uint8_t channels;
+
+	uint64_t index(uint64_t slot) const { return skipChannels(start + slot / rowSlots * stride, slot % rowSlots, channels); }
+};
+
+Region dataRegion(Image &inputImage, const Header &header, uint64_t dataIterator);
+
+//capacity
+uint64_t dataSlots(uint64_t bytes, uint8_t mode);
+uint64_t dataSlots(const Header &header, uint64_t bytes);
+uint32_t modeChunkSize(uint8_t mode);
+bool fits(Image &inputImage, const Header &header, uint64_t start = 1);
+uint64_t availableBytes(Image &inputImage, Header header, uint64_t start = 1);
+void selectMode(Image &inputImage, Header &header, uint64_t start = 1);
+void checkCapacity(Image &inputImage, uint64_t dataSize);
+
+//compression stage
+std::vector<uint8_t> compressData(const uint8_t* fileData, uint64_t fileSize, Header &header);
+void decompressData(const Header &header, uint64_t firstBlock, uint64_t count, const uint8_t* stored, uint8_t* fileData);
+
+//kernels
+uint64_t insertChunk(uint8_t* imgData, uint64_t imgIterator, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode, uint8_t channels);
+uint64_t retrieveChunk(const uint8_t* imgData, uint64_t imgIterator, uint8_t* fileData, uint64_t chunkSize, uint8_t mode, uint8_t channels);
+uint64_t insertScattered(uint8_t* imgData, const Scatter &scatter, uint64_t slot, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode);
+uint64_t retrieveScattered(const uint8_t* imgData, const Scatter &scatter, uint64_t slot, uint8_t* fileData, uint64_t chunkSize, uint8_t mode);
+uint64_t matchChunk(uint8_t* imgData, uint64_t imgIterator, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode, uint8_t channels, const MatchNoise &noise, uint64_t slot);
+uint64_t insertSelected(uint8_t* imgData, const Selection &selection, uint64_t slot, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode);
+uint64_t retrieveSelected(const uint8_t* imgData, const Selection &selection, uint64_t slot, uint8_t* fileData, uint64_t chunkSize, uint8_t mode);
+uint64_t insertRegion(uint8_t* imgData, const Region &region, uint64_t slot, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode, const MatchNoise* noise);
+uint64_t retrieveRegion(const uint8_t* imgData, const Region &region, uint64_t slot, uint8_t* fileData, uint64_t chunkSize, uint8_t mode);
+uint64_t insertCoded(uint8_t* imgData, const Region &region, const Scatter* scatter, const Selection* selection, uint64_t slot, const uint8_t* fileData, uint64_t size, const Header &header, const MatchNoise* noise, const uint8_t* costs);
+uint64_t retrieveCoded(const uint8_t* imgData, const Region &region, const Scatter* scatter, const Selection* selection, uint64_t slot, uint8_t* fileData, uint64_t size, const Header &header);
+uint64_t matchScattered(uint8_t* imgData, const Scatter &scatter, uint64_t slot, const uint8_t* fileData, uint64_t chunkSize, uint8_t mode, const MatchNoise &noise);
+
+//insertion, insertData returns the header written in the image
+void writeHeader(Image &inputImage, const Header &header, Key *inputKey, uint64_t start = 1);
+Header insertData(Image &inputImage, File &inputFile, Key *inputKey = nullptr, const InsertOptions &options = {});
+
+//multi-slot carriers: every payload is a full embedding of its own in a band of rows, listed by a plain directory header
+//slots are embedded at the same time in their own bands, each with its share of the threads, so every row of the carrier is visited once
+std::array<uint8_t, Header::slotIdSize> slotId(Key *inputKey);
+std::vector<Header> insertSlots(Image &inputImage, const std::vector<File*> &files, const std::vector<Key*> &keys, const InsertOptions &options = {});
+bool readDirectory(Image &inputImage, Header &directory);
+Image slotImage(Image &inputImage, Key *inputKey); //rows of the slot of the key, the whole image without a directory
+
+//append mode: new data goes after the data already in the image as an entry with its own header,
+//the existing entries are read to find the end of the chain but never rewritten
+struct Entry{
+	Header header;
+	uint64_t dataIterator;
+	uint64_t start = 1; //channel of the header
+};
+Header appendData(Image &inputImage, File &inputFile, Key *inputKey = nullptr, InsertOptions options = {});
+void entryIv(const uint8_t* iv, const Header &header, uint8_t* entry); //IV of the keystreams of an entry
+
+//update mode: the data of entry 'entry' (0 for the first) is replaced by a file of the same size,
+//only the chunks with changed bytes are encrypted and embedded again and the headers rewritten with their new checksums
+struct Update{
+	uint64_t bytes = 0;   //changed bytes
+	uint64_t chunks = 0;  //rewritten chunks
+	Header header;
+};
+Update updateData(Image &inputImage, File &inputFile, Key *inputKey = nullptr, uint32_t entry = 0);
+
+//end of the image bytes changed by the data of the key and the highest mode of it, 0 without data,
+//the whole image for scattered and adaptive data
+uint64_t dataExtent(Image &inputImage, Key *inputKey, uint8_t &mode);
+
+//retrieval
+bool readHeader(Image &inputImage, Key *inputKey, Header &header, uint64_t &dataIterator);
+std::vector<Entry> readEntries(Image &inputImage, Key *inputKey); //every entry of the key in order, empty without data
+void extractData(Image &inputImage, Key *inputKey, const Header &header, uint64_t dataIterator, uint64_t offset, uint64_t size, uint8_t* fileData);
+void readData(Image &inputImage, Key *inputKey, const Header &header, uint64_t dataIterator, uint64_t offset, uint64_t size, uint8_t* fileData);
+void readFileData(Image &inputImage, Key *inputKey, const Header &header, uint64_t dataIterator, uint64_t offset, uint64_t size, uint8_t* fileData);
+std::string readExtension(Image &inputImage, Key *inputKey, const Header &header, uint64_t dataIterator);
+
+#endif
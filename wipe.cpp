@@ -0,0 +1,61 @@
+#include "wipe.hpp"
+
+#include <algorithm>
+
+#include "file.hpp"
+#include "matching.hpp"
+#include "stego.hpp"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    #include <immintrin.h>
+    #define WIPE_SIMD 1
+#endif
+
+void wipePlanes(Image &image, uint64_t first, uint64_t end, uint8_t bits, bool zero){
+    Span span("wipe", end - first);
+
+    uint8_t* data = image.data();
+    int channels = image.channels();
+
+    //wiped bits of the 16 bytes of a vector that starts at a multiple of 16
+    uint8_t low = (1 << bits) - 1;
+    uint8_t mask[16];
+    for (int i = 0; i < 16; i++)
+        mask[i] = channels % 2 == 0 && i % channels == channels - 1 ? 0 : low;
+
+    uint8_t seed[MatchNoise::seedSize];
+    randomBytes(seed, sizeof(seed));
+    MatchNoise noise(seed);
+
+    auto wipeByte = [&](uint64_t i) {
+        uint8_t value = zero ? 0 : noise.word(i / 8) >> (i % 8 * 8);
+        data[i] = (data[i] & ~mask[i % 16]) | (value & mask[i % 16]);
+    };
+
+    //bands start at a multiple of 16 so the mask lines up with every vector
+    uint64_t start = first & ~uint64_t(15);
+
+    runParallel(end - start, 16, [&](uint64_t offset, uint64_t size) {
+        uint64_t i = std::max(start + offset, first), last = start + offset + size;
+
+        for (; i < last && i % 16 != 0; i++)
+            wipeByte(i);
+
+#ifdef WIPE_SIMD
+        const __m128i keep = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask)), _mm_set1_epi8(-1));
+
+        for (; i + 16 <= last; i += 16){
+            __m128i* pixels = reinterpret_cast<__m128i*>(data + i);
+            __m128i value = _mm_and_si128(_mm_loadu_si128(pixels), keep);
+
+            if(!zero)
+                value = _mm_or_si128(value, _mm_andnot_si128(keep, _mm_set_epi64x(noise.word(i / 8 + 1), noise.word(i / 8))));
+
+            _mm_storeu_si128(pixels, value);
+        }
+#endif
+
+        for (; i < last; i++)
+            wipeByte(i);
+    });
+}
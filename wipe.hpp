@@ -0,0 +1,20 @@
+#ifndef WIPE_HPP
+#define WIPE_HPP
+
+#include <cstdint>
+
+#include "image.hpp"
+
+/*
+    LSB wipe: the low 'bits' bits of every usable channel in image bytes [first, end) are replaced by noise
+    or cleared, so nothing hidden in them survives. Alpha channels (the last one of 2 and 4 channel images)
+    are never changed.
+
+    The bytes are split in parallel bands of whole 16 byte vectors, with 2 and 4 channels the alpha channels are
+    at the same lanes of every vector so one mask covers them. Noise is splitmix64 (see MatchNoise) with a fresh
+    random seed at counter = byte / 8, so every band starts anywhere without sharing a generator.
+*/
+
+void wipePlanes(Image &image, uint64_t first, uint64_t end, uint8_t bits, bool zero);
+
+#endif